@@ -5,10 +5,23 @@
 #include <shlwapi.h>
 #include <thread>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <memory>
 #include <locale>
 #include <codecvt>
 #include <list>
+#include <map>
+#include <set>
+#include <queue>
+#include <tuple>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <shlobj_core.h>
+#include <emmintrin.h>
 #include "pack.h"
 
 #define FILE_MAX_PATH 4096
@@ -120,6 +133,27 @@ namespace util
 
 		static const size_t MAX_OVER = 10;
 	};
+
+	// runs task(i) for every i in [0, count) spread over all hardware threads (or at most maxWorkers), returns once every task is done
+	template<class Task> void parallelFor(const size_t count, const Task& task, const size_t maxWorkers = 0)
+	{
+		size_t workers = std::min<size_t>(count, std::max(1u, std::thread::hardware_concurrency()));
+		if (maxWorkers)
+			workers = std::min(workers, maxWorkers);
+		std::atomic<size_t> next(0);
+		std::vector<std::thread> threads;
+		for (size_t t = 1; t < workers; ++t)
+			threads.emplace_back([&]()
+			{
+				for (size_t i = next++; i < count; i = next++)
+					task(i);
+			});
+
+		for (size_t i = next++; i < count; i = next++)
+			task(i);
+		for (size_t t = 0; t < threads.size(); ++t)
+			threads[t].join();
+	}
 }
 
 namespace os
@@ -345,33 +379,3254 @@ namespace os
 	};
 	const HWND SystemData::hwnd = GetConsoleWindow();
 
-	bool directoryExists(LPCTSTR szPath)
-	{
-		DWORD dwAttrib = GetFileAttributes(szPath);
+	bool directoryExists(LPCTSTR szPath)
+	{
+		DWORD dwAttrib = GetFileAttributes(szPath);
+
+		return (dwAttrib != INVALID_FILE_ATTRIBUTES &&
+			(dwAttrib & FILE_ATTRIBUTE_DIRECTORY));
+	}
+
+	std::wstring getAvailableDir(std::wstring path)
+	{
+		unsigned short int cnt = 1;
+		std::wstring copyTemp = path;
+		while (directoryExists(path.c_str()))
+		{
+			path = copyTemp + L'(' + std::to_wstring(cnt) + L')';
+			++cnt;
+		}
+		return path;
+	}
+
+	std::string getWD()
+	{
+		wchar_t result[MAX_PATH];
+		GetModuleFileName(NULL, result, MAX_PATH);
+		return util::toString(std::wstring(result).substr(0, std::wstring(result).rfind('\\')));
+	}
+
+}
+
+namespace px
+{
+	// raw RGBA8 kernels, rows are tightly packed (stride = width * 4)
+
+	class Bitmap
+	{
+	public:
+		sf::Vector2u size;
+		std::vector<sf::Uint8> pixels;
+
+		Bitmap() {}
+		Bitmap(const sf::Vector2u& size) :
+			size(size),
+			pixels(static_cast<size_t>(size.x) * size.y * 4, 0)
+		{}
+		Bitmap(const sf::Image& image) :
+			size(image.getSize()),
+			pixels(image.getPixelsPtr(), image.getPixelsPtr() + static_cast<size_t>(image.getSize().x) * image.getSize().y * 4)
+		{}
+
+		inline size_t stride() const { return static_cast<size_t>(size.x) * 4; }
+		inline sf::Uint8* row(const unsigned int y) { return pixels.data() + y * stride(); }
+		inline const sf::Uint8* row(const unsigned int y) const { return pixels.data() + y * stride(); }
+
+		sf::Image toImage() const
+		{
+			sf::Image image;
+			if (size.x && size.y)
+				image.create(size.x, size.y, pixels.data());
+			else
+				image.create(size.x, size.y, sf::Color(0, 0, 0, 0));
+			return image;
+		}
+	};
+
+	// copies the pixels of src that are visible or land on transparent pixels of dst
+	void composeRow(const sf::Uint8* src, sf::Uint8* dst, const unsigned int count)
+	{
+		const __m128i alphaMask = _mm_set1_epi32(static_cast<int>(0xFF000000));
+		const __m128i zero = _mm_setzero_si128();
+
+		unsigned int x = 0;
+		for (; x + 4 <= count; x += 4)
+		{
+			const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+			const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + x * 4));
+			const __m128i keep = _mm_andnot_si128(_mm_cmpeq_epi32(_mm_and_si128(d, alphaMask), zero), _mm_cmpeq_epi32(_mm_and_si128(s, alphaMask), zero));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), _mm_or_si128(_mm_and_si128(keep, d), _mm_andnot_si128(keep, s)));
+		}
+		for (; x < count; ++x)
+			if (src[x * 4 + 3] || !dst[x * 4 + 3])
+				std::memcpy(dst + x * 4, src + x * 4, 4);
+	}
+
+	// true for images holding a single value per pixel, either grey and opaque or white with any alpha,
+	// the colour under fully transparent pixels doesn't matter
+	bool isSingleChannel(const sf::Uint8* pixels, const sf::Vector2u& size, const size_t stride)
+	{
+		bool opaque = true, white = true;
+		for (unsigned int y = 0; y < size.y; ++y)
+		{
+			const sf::Uint8* row = pixels + y * stride;
+			for (unsigned int x = 0; x < size.x; ++x)
+			{
+				const sf::Uint8* p = row + x * 4;
+				if (!p[3])
+					continue;
+				if (p[0] != p[1] || p[1] != p[2])
+					return false;
+				opaque = opaque && p[3] == 255;
+				white = white && p[0] == 255;
+				if (!opaque && !white)
+					return false;
+			}
+		}
+		return true;
+	}
+
+	// writes the value of a single channel image (grey times alpha) into one channel of dst, the larger value wins
+	// so sprites of the other layers, and nested ones of the same layer, are left alone
+	void composeChannelRow(const sf::Uint8* src, sf::Uint8* dst, const unsigned int count, const unsigned int channel)
+	{
+		for (unsigned int x = 0; x < count; ++x)
+		{
+			const sf::Uint8 value = static_cast<sf::Uint8>((src[x * 4] * src[x * 4 + 3] + 127) / 255);
+			dst[x * 4 + channel] = std::max(dst[x * 4 + channel], value);
+		}
+	}
+
+	inline bool _anyAlphaAbove(const sf::Uint8* row, const unsigned int count, const sf::Uint8 threshold)
+	{
+		const __m128i alphaMask = _mm_set1_epi32(static_cast<int>(0xFF000000));
+		const __m128i thr = _mm_set1_epi32(static_cast<int>(static_cast<unsigned int>(threshold) << 24));
+		const __m128i zero = _mm_setzero_si128();
+
+		unsigned int x = 0;
+		for (; x + 4 <= count; x += 4)
+		{
+			const __m128i v = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x * 4)), alphaMask);
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(v, thr), zero)) != 0xFFFF)
+				return true;
+		}
+		for (; x < count; ++x)
+			if (row[x * 4 + 3] > threshold)
+				return true;
+		return false;
+	}
+
+	// index of the first pixel in [0, count) with alpha above the threshold, count if there is none
+	inline unsigned int _firstAlphaAbove(const sf::Uint8* row, const unsigned int count, const sf::Uint8 threshold)
+	{
+		const __m128i alphaMask = _mm_set1_epi32(static_cast<int>(0xFF000000));
+		const __m128i thr = _mm_set1_epi32(static_cast<int>(static_cast<unsigned int>(threshold) << 24));
+		const __m128i zero = _mm_setzero_si128();
+
+		unsigned int x = 0;
+		for (; x + 4 <= count; x += 4)
+		{
+			const __m128i v = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x * 4)), alphaMask);
+			const int mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(v, thr), zero)) & 0x8888;
+			if (mask)
+				for (unsigned int i = 0; i < 4; ++i)
+					if (mask & (0x8 << (i * 4)))
+						return x + i;
+		}
+		for (; x < count; ++x)
+			if (row[x * 4 + 3] > threshold)
+				return x;
+		return count;
+	}
+
+	// index of the last pixel in [0, count) with alpha above the threshold, count if there is none
+	inline unsigned int _lastAlphaAbove(const sf::Uint8* row, const unsigned int count, const sf::Uint8 threshold)
+	{
+		const __m128i alphaMask = _mm_set1_epi32(static_cast<int>(0xFF000000));
+		const __m128i thr = _mm_set1_epi32(static_cast<int>(static_cast<unsigned int>(threshold) << 24));
+		const __m128i zero = _mm_setzero_si128();
+
+		unsigned int x = count;
+		for (; x >= 4; x -= 4)
+		{
+			const __m128i v = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + (x - 4) * 4)), alphaMask);
+			const int mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(v, thr), zero)) & 0x8888;
+			if (mask)
+				for (int i = 3; i >= 0; --i)
+					if (mask & (0x8 << (i * 4)))
+						return x - 4 + i;
+		}
+		while (x > 0)
+		{
+			--x;
+			if (row[x * 4 + 3] > threshold)
+				return x;
+		}
+		return count;
+	}
+
+	// smallest rect containing every pixel with alpha above the threshold, 1x1 for fully transparent images
+	sf::IntRect findOpaqueBounds(const sf::Uint8* pixels, const sf::Vector2u& size, const sf::Uint8 threshold)
+	{
+		const size_t stride = static_cast<size_t>(size.x) * 4;
+
+		unsigned int top = 0, bottom = size.y;
+		while (top < size.y && !_anyAlphaAbove(pixels + top * stride, size.x, threshold))
+			++top;
+		if (top == size.y)
+			return sf::IntRect(0, 0, 1, 1);
+		while (bottom > top && !_anyAlphaAbove(pixels + (bottom - 1) * stride, size.x, threshold))
+			--bottom;
+
+		// column scan only needs to look at the pixels outside of the current [left, right) span
+		unsigned int left = size.x, right = 0;
+		for (unsigned int y = top; y < bottom; ++y)
+		{
+			const sf::Uint8* row = pixels + y * stride;
+			const unsigned int first = _firstAlphaAbove(row, left, threshold);
+			if (first < left)
+				left = first;
+			if (right < size.x)
+			{
+				const unsigned int last = _lastAlphaAbove(row + right * 4, size.x - right, threshold);
+				if (last != size.x - right)
+					right = right + last + 1;
+			}
+		}
+
+		return sf::IntRect(left, top, right - left, bottom - top);
+	}
+
+	inline void _transpose4(__m128i& a, __m128i& b, __m128i& c, __m128i& d)
+	{
+		const __m128i t0 = _mm_unpacklo_epi32(a, b), t1 = _mm_unpacklo_epi32(c, d);
+		const __m128i t2 = _mm_unpackhi_epi32(a, b), t3 = _mm_unpackhi_epi32(c, d);
+		a = _mm_unpacklo_epi64(t0, t1);
+		b = _mm_unpackhi_epi64(t0, t1);
+		c = _mm_unpacklo_epi64(t2, t3);
+		d = _mm_unpackhi_epi64(t2, t3);
+	}
+
+	// writes the width x height source rotated 90 degrees clockwise as a height x width image
+	// works on 64x64 tiles so both the rows read and the rows written stay in cache, 4x4 pixel blocks are transposed in registers
+	void rotateClockwise(const sf::Uint8* src, const unsigned int width, const unsigned int height, const size_t srcStride, sf::Uint8* dst, const size_t dstStride)
+	{
+		const unsigned int tile = 64;
+		for (unsigned int ty = 0; ty < height; ty += tile)
+			for (unsigned int tx = 0; tx < width; tx += tile)
+			{
+				const unsigned int yEnd = std::min(ty + tile, height), xEnd = std::min(tx + tile, width);
+				for (unsigned int y = ty; y < yEnd; y += 4)
+					for (unsigned int x = tx; x < xEnd; x += 4)
+					{
+						if (y + 4 <= yEnd && x + 4 <= xEnd)
+						{
+							const sf::Uint8* s = src + y * srcStride + x * 4;
+							__m128i r0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+							__m128i r1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + srcStride));
+							__m128i r2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + srcStride * 2));
+							__m128i r3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + srcStride * 3));
+							// bottom row first, source column j becomes destination row x + j
+							_transpose4(r3, r2, r1, r0);
+							sf::Uint8* d = dst + x * dstStride + (height - 4 - y) * 4;
+							_mm_storeu_si128(reinterpret_cast<__m128i*>(d), r3);
+							_mm_storeu_si128(reinterpret_cast<__m128i*>(d + dstStride), r2);
+							_mm_storeu_si128(reinterpret_cast<__m128i*>(d + dstStride * 2), r1);
+							_mm_storeu_si128(reinterpret_cast<__m128i*>(d + dstStride * 3), r0);
+						}
+						else
+						{
+							for (unsigned int by = y; by < std::min(y + 4, yEnd); ++by)
+								for (unsigned int bx = x; bx < std::min(x + 4, xEnd); ++bx)
+									std::memcpy(dst + bx * dstStride + (height - 1 - by) * 4, src + by * srcStride + bx * 4, 4);
+						}
+					}
+			}
+	}
+
+	inline void _fill(sf::Uint8* dst, const unsigned int count, const sf::Uint8* pixel)
+	{
+		sf::Uint32 value;
+		std::memcpy(&value, pixel, 4);
+		const __m128i v = _mm_set1_epi32(static_cast<int>(value));
+
+		unsigned int i = 0;
+		for (; i + 4 <= count; i += 4)
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), v);
+		for (; i < count; ++i)
+			std::memcpy(dst + i * 4, pixel, 4);
+	}
+
+	// copies the image into dst with its border pixels repeated extrude times on every side
+	// dst has to hold (width + 2 * extrude) x (height + 2 * extrude) pixels
+	void extrude(const sf::Uint8* src, const unsigned int width, const unsigned int height, const size_t srcStride, sf::Uint8* dst, const size_t dstStride, const unsigned int extrude)
+	{
+		for (unsigned int y = 0; y < height; ++y)
+		{
+			sf::Uint8* row = dst + (y + extrude) * dstStride;
+			const sf::Uint8* s = src + y * srcStride;
+			std::memcpy(row + extrude * 4, s, static_cast<size_t>(width) * 4);
+			_fill(row, extrude, s);
+			_fill(row + (extrude + width) * 4, extrude, s + (width - 1) * 4);
+		}
+
+		const size_t rowBytes = static_cast<size_t>(width + 2 * extrude) * 4;
+		for (unsigned int e = 0; e < extrude; ++e)
+		{
+			std::memcpy(dst + e * dstStride, dst + extrude * dstStride, rowBytes);
+			std::memcpy(dst + (extrude + height + e) * dstStride, dst + (extrude + height - 1) * dstStride, rowBytes);
+		}
+	}
+
+	// gives fully transparent pixels the colour of the nearest visible ones so filtering doesn't pull in black fringes
+	// the colour spreads one ring of pixels at a time, each pixel taking the average of its neighbours filled by the
+	// rings before, so every pixel is visited once, alpha is left untouched, passes limits how many rings get filled (0 fills everything reachable)
+	void bleedAlpha(sf::Uint8* pixels, const unsigned int width, const unsigned int height, const size_t stride, unsigned int passes = 0)
+	{
+		// 0 empty, 1 in the next ring, 2 filled
+		std::vector<sf::Uint8> state(static_cast<size_t>(width) * height, 0);
+		for (unsigned int y = 0; y < height; ++y)
+			for (unsigned int x = 0; x < width; ++x)
+				if (pixels[y * stride + x * 4 + 3])
+					state[static_cast<size_t>(y) * width + x] = 2;
+
+		// the pixels left, right, above and below, returns how many there are
+		const auto around = [&](const size_t i, size_t* n)
+		{
+			const unsigned int x = static_cast<unsigned int>(i % width), y = static_cast<unsigned int>(i / width);
+			size_t count = 0;
+			if (x > 0)
+				n[count++] = i - 1;
+			if (x + 1 < width)
+				n[count++] = i + 1;
+			if (y > 0)
+				n[count++] = i - width;
+			if (y + 1 < height)
+				n[count++] = i + width;
+			return count;
+		};
+
+		std::vector<size_t> ring, next;
+		const auto queue = [&](const size_t i, std::vector<size_t>& to)
+		{
+			size_t n[4];
+			for (size_t k = 0, count = around(i, n); k < count; ++k)
+				if (!state[n[k]])
+				{
+					state[n[k]] = 1;
+					to.push_back(n[k]);
+				}
+		};
+		for (size_t i = 0; i < state.size(); ++i)
+			if (state[i] == 2)
+				queue(i, ring);
+
+		for (unsigned int p = 0; !ring.empty() && (!passes || p < passes); ++p)
+		{
+			// a ring only reads filled pixels, so it can be written in place
+			for (size_t r = 0; r < ring.size(); ++r)
+			{
+				size_t n[4];
+				unsigned int sum[3] = { 0, 0, 0 }, filled = 0;
+				for (size_t k = 0, count = around(ring[r], n); k < count; ++k)
+					if (state[n[k]] == 2)
+					{
+						const sf::Uint8* s = pixels + (n[k] / width) * stride + (n[k] % width) * 4;
+						sum[0] += s[0], sum[1] += s[1], sum[2] += s[2];
+						++filled;
+					}
+				sf::Uint8* d = pixels + (ring[r] / width) * stride + (ring[r] % width) * 4;
+				for (size_t c = 0; c < 3; ++c)
+					d[c] = static_cast<sf::Uint8>(sum[c] / filled);
+			}
+			for (size_t r = 0; r < ring.size(); ++r)
+				state[ring[r]] = 2;
+
+			next.clear();
+			for (size_t r = 0; r < ring.size(); ++r)
+				queue(ring[r], next);
+			ring.swap(next);
+		}
+	}
+
+	enum class Filter
+	{
+		Box,
+		Bilinear,
+		Lanczos3
+	};
+
+	inline double _filterKernel(const Filter filter, const double x)
+	{
+		switch (filter)
+		{
+		case Filter::Box:
+			return x >= -0.5 && x < 0.5 ? 1.0 : 0.0;
+		case Filter::Bilinear:
+			return std::max(0.0, 1.0 - std::abs(x));
+		default:
+			if (x == 0.0)
+				return 1.0;
+			if (std::abs(x) >= 3.0)
+				return 0.0;
+			const double pix = 3.14159265358979323846 * x;
+			return 3.0 * std::sin(pix) * std::sin(pix / 3.0) / (pix * pix);
+		}
+	}
+
+	// fixed point taps of one axis, every output sample reads the same (even) number of clamped source samples
+	class ResampleWeights
+	{
+	public:
+		static const int Shift = 14;
+		unsigned int taps = 0;
+		std::vector<unsigned int> index;
+		std::vector<sf::Int16> weight;
+
+		ResampleWeights(const unsigned int srcSize, const unsigned int dstSize, const Filter filter)
+		{
+			// downscaling stretches the filter over the source so every texel contributes
+			const double scale = static_cast<double>(dstSize) / srcSize;
+			const double stretch = std::max(1.0, 1.0 / scale);
+			const double radius = (filter == Filter::Box ? 0.5 : filter == Filter::Bilinear ? 1.0 : 3.0) * stretch;
+			taps = static_cast<unsigned int>(std::ceil(radius * 2.0)) + 1;
+			taps += taps & 1;
+
+			index.resize(static_cast<size_t>(dstSize) * taps);
+			weight.resize(static_cast<size_t>(dstSize) * taps);
+			std::vector<double> w(taps);
+			for (unsigned int i = 0; i < dstSize; ++i)
+			{
+				const double center = (i + 0.5) / scale;
+				const int first = static_cast<int>(std::floor(center - radius));
+				double sum = 0.0;
+				for (unsigned int k = 0; k < taps; ++k)
+					sum += w[k] = _filterKernel(filter, (first + static_cast<int>(k) + 0.5 - center) / stretch);
+				if (sum == 0.0)
+				{
+					std::fill(w.begin(), w.end(), 0.0);
+					w[std::min(taps - 1, static_cast<unsigned int>(center - first))] = sum = 1.0;
+				}
+
+				// the largest tap takes the rounding error so flat areas stay flat
+				int total = 0;
+				unsigned int largest = 0;
+				for (unsigned int k = 0; k < taps; ++k)
+				{
+					const int source = std::min(std::max(first + static_cast<int>(k), 0), static_cast<int>(srcSize) - 1);
+					index[i * taps + k] = static_cast<unsigned int>(source);
+					weight[i * taps + k] = static_cast<sf::Int16>(std::lround(w[k] / sum * (1 << Shift)));
+					total += weight[i * taps + k];
+					if (w[k] > w[largest])
+						largest = k;
+				}
+				weight[i * taps + largest] += static_cast<sf::Int16>((1 << Shift) - total);
+			}
+		}
+	};
+
+	inline __m128i _weightPair(const sf::Int16* w)
+	{
+		return _mm_set1_epi32(static_cast<int>(static_cast<sf::Uint16>(w[0]) | static_cast<unsigned int>(static_cast<sf::Uint16>(w[1])) << 16));
+	}
+	// rounds the Q14 sums back to the 12 bit working range
+	inline __m128i _finishSamples(const __m128i lo, const __m128i hi)
+	{
+		const __m128i half = _mm_set1_epi32(1 << (ResampleWeights::Shift - 1));
+		const __m128i v = _mm_packs_epi32(
+			_mm_srai_epi32(_mm_add_epi32(lo, half), ResampleWeights::Shift),
+			_mm_srai_epi32(_mm_add_epi32(hi, half), ResampleWeights::Shift));
+		return _mm_min_epi16(_mm_max_epi16(v, _mm_setzero_si128()), _mm_set1_epi16(4095));
+	}
+
+	// separable resize of an RGBA image, filtering runs on premultiplied 12 bit samples so transparent texels don't
+	// darken the edges, linear treats the colour as sRGB and filters it in linear light,
+	// channels filters the four bytes as independent plain values (channel packed masks), without alpha weighting or sRGB
+	void resample(const sf::Uint8* src, const unsigned int srcWidth, const unsigned int srcHeight, const size_t srcStride,
+		sf::Uint8* dst, const unsigned int dstWidth, const unsigned int dstHeight, const size_t dstStride, const Filter filter, const bool linear = false,
+		const bool channels = false)
+	{
+		if (!srcWidth || !srcHeight || !dstWidth || !dstHeight)
+			return;
+
+		static const struct Tables
+		{
+			sf::Uint16 toWork[2][256];
+			sf::Uint8 fromWork[2][4096];
+
+			Tables()
+			{
+				for (int i = 0; i < 256; ++i)
+				{
+					const double c = i / 255.0;
+					toWork[0][i] = static_cast<sf::Uint16>(std::lround(c * 4095.0));
+					toWork[1][i] = static_cast<sf::Uint16>(std::lround((c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4)) * 4095.0));
+				}
+				for (int i = 0; i < 4096; ++i)
+				{
+					const double c = i / 4095.0;
+					fromWork[0][i] = static_cast<sf::Uint8>(std::lround(c * 255.0));
+					fromWork[1][i] = static_cast<sf::Uint8>(std::lround((c <= 0.0031308 ? c * 12.92 : 1.055 * std::pow(c, 1.0 / 2.4) - 0.055) * 255.0));
+				}
+			}
+		} tables;
+		const sf::Uint16* toWork = tables.toWork[linear && !channels];
+		const sf::Uint8* fromWork = tables.fromWork[linear && !channels];
+
+		const ResampleWeights horizontal(srcWidth, dstWidth, filter), vertical(srcHeight, dstHeight, filter);
+
+		// horizontal pass into a buffer of source rows, padded to an even width for the two pixel vertical kernel
+		const size_t midStride = static_cast<size_t>(dstWidth + (dstWidth & 1)) * 4;
+		std::vector<sf::Int16> mid(midStride * srcHeight, 0);
+		util::parallelFor(srcHeight, [&](const size_t y)
+		{
+			std::vector<sf::Int16> row(static_cast<size_t>(srcWidth) * 4 + 4);
+			const sf::Uint8* s = src + y * srcStride;
+			for (unsigned int x = 0; x < srcWidth; ++x)
+			{
+				const unsigned int a = s[x * 4 + 3];
+				for (unsigned int c = 0; c < 3; ++c)
+					row[x * 4 + c] = static_cast<sf::Int16>(channels ? toWork[s[x * 4 + c]] : (toWork[s[x * 4 + c]] * a + 127) / 255);
+				row[x * 4 + 3] = static_cast<sf::Int16>(tables.toWork[0][a]);
+			}
+
+			sf::Int16* out = mid.data() + y * midStride;
+			for (unsigned int x = 0; x < dstWidth; ++x)
+			{
+				const unsigned int* idx = horizontal.index.data() + static_cast<size_t>(x) * horizontal.taps;
+				const sf::Int16* w = horizontal.weight.data() + static_cast<size_t>(x) * horizontal.taps;
+				__m128i acc = _mm_setzero_si128();
+				for (unsigned int k = 0; k < horizontal.taps; k += 2)
+				{
+					const __m128i a = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(row.data() + idx[k] * 4));
+					const __m128i b = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(row.data() + idx[k + 1] * 4));
+					acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), _weightPair(w + k)));
+				}
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(out + x * 4), _finishSamples(acc, acc));
+			}
+		});
+
+		// vertical pass two pixels at a time, then back to straight 8 bit colour
+		util::parallelFor(dstHeight, [&](const size_t y)
+		{
+			std::vector<sf::Int16> row(midStride);
+			const unsigned int* idx = vertical.index.data() + y * vertical.taps;
+			const sf::Int16* w = vertical.weight.data() + y * vertical.taps;
+			for (unsigned int x = 0; x < dstWidth; x += 2)
+			{
+				__m128i lo = _mm_setzero_si128(), hi = _mm_setzero_si128();
+				for (unsigned int k = 0; k < vertical.taps; k += 2)
+				{
+					const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mid.data() + idx[k] * midStride + x * 4));
+					const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mid.data() + idx[k + 1] * midStride + x * 4));
+					const __m128i pair = _weightPair(w + k);
+					lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), pair));
+					hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), pair));
+				}
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(row.data() + x * 4), _finishSamples(lo, hi));
+			}
+
+			sf::Uint8* d = dst + y * dstStride;
+			if (channels)
+			{
+				for (size_t i = 0; i < static_cast<size_t>(dstWidth) * 4; ++i)
+					d[i] = fromWork[row[i]];
+				return;
+			}
+			for (unsigned int x = 0; x < dstWidth; ++x)
+			{
+				const int a = row[x * 4 + 3];
+				if (!a)
+				{
+					std::memset(d + x * 4, 0, 4);
+					continue;
+				}
+				// ringing can push premultiplied colour above alpha
+				for (unsigned int c = 0; c < 3; ++c)
+					d[x * 4 + c] = fromWork[(std::min<int>(row[x * 4 + c], a) * 4095 + a / 2) / a];
+				d[x * 4 + 3] = tables.fromWork[0][a];
+			}
+		});
+	}
+
+	// one bit per cell, every row is padded to whole 64 bit words plus one spare word so shifted tests never run out of bounds
+	class BitMask
+	{
+		unsigned int _width = 0, _height = 0, _words = 0;
+		std::vector<sf::Uint64> _bits;
+
+	public:
+		BitMask() {}
+		BitMask(const unsigned int width, const unsigned int height) :
+			_width(width),
+			_height(height),
+			_words((width + 63) / 64 + 1),
+			_bits(static_cast<size_t>(_words) * height, 0)
+		{}
+
+		inline unsigned int width() const { return _width; }
+		inline unsigned int height() const { return _height; }
+		inline unsigned int words() const { return _words; }
+
+		inline sf::Uint64* row(const unsigned int y) { return &_bits[static_cast<size_t>(y) * _words]; }
+		inline const sf::Uint64* row(const unsigned int y) const { return &_bits[static_cast<size_t>(y) * _words]; }
+
+		size_t count() const
+		{
+			size_t result = 0;
+			for (size_t i = 0; i < _bits.size(); ++i)
+				for (sf::Uint64 word = _bits[i]; word; word &= word - 1)
+					++result;
+			return result;
+		}
+
+		inline bool test(const unsigned int x, const unsigned int y) const { return (row(y)[x >> 6] >> (x & 63)) & 1; }
+		inline void set(const unsigned int x, const unsigned int y) { row(y)[x >> 6] |= sf::Uint64(1) << (x & 63); }
+
+		// first cell at or after x in row y that is set (or clear), width when there's none
+		unsigned int nextSet(const unsigned int x, const unsigned int y) const { return _next(x, y, 0); }
+		unsigned int nextClear(const unsigned int x, const unsigned int y) const { return _next(x, y, ~sf::Uint64(0)); }
+
+		// last set cell of row y in [from, to), to when there's none
+		unsigned int lastSet(const unsigned int from, const unsigned int to, const unsigned int y) const
+		{
+			const sf::Uint64* bits = row(y);
+			for (unsigned int q = (to - 1) >> 6; from < to; --q)
+			{
+				sf::Uint64 word = bits[q];
+				if (q == (to - 1) >> 6)
+					word &= ~sf::Uint64(0) >> (63 - ((to - 1) & 63));
+				if (q == from >> 6)
+					word &= ~sf::Uint64(0) << (from & 63);
+				if (word)
+				{
+					// highest set bit by halving
+					unsigned int b = 0;
+					for (unsigned int shift = 32; shift; shift >>= 1)
+						if (word >> shift)
+						{
+							word >>= shift;
+							b += shift;
+						}
+					return q * 64 + b;
+				}
+				if (q == from >> 6)
+					break;
+			}
+			return to;
+		}
+
+	private:
+		unsigned int _next(const unsigned int x, const unsigned int y, const sf::Uint64 flip) const
+		{
+			const sf::Uint64* bits = row(y);
+			for (unsigned int q = x >> 6; x < _width && q * 64 < _width; ++q)
+			{
+				sf::Uint64 word = bits[q] ^ flip;
+				if (q == x >> 6)
+					word &= ~sf::Uint64(0) << (x & 63);
+				if (!word)
+					continue;
+
+				// lowest set bit by halving
+				unsigned int b = 0;
+				for (unsigned int shift = 32; shift; shift >>= 1)
+					if (!(word & ((sf::Uint64(1) << shift) - 1)))
+					{
+						word >>= shift;
+						b += shift;
+					}
+				return std::min(_width, q * 64 + b);
+			}
+			return _width;
+		}
+
+	public:
+		void addRows(const unsigned int count)
+		{
+			_height += count;
+			_bits.resize(static_cast<size_t>(_words) * _height, 0);
+		}
+
+		// the first row of other, placed with its top left cell at (x, y), that shares a set bit with this mask,
+		// the height of other when none does
+		unsigned int firstOverlap(const BitMask& other, const unsigned int x, const unsigned int y) const
+		{
+			const unsigned int q = x >> 6, b = x & 63;
+			const unsigned int used = (other._width + 63) / 64;
+			for (unsigned int r = 0; r < other._height; ++r)
+			{
+				const sf::Uint64* dst = row(y + r) + q;
+				const sf::Uint64* src = other.row(r);
+				for (unsigned int k = 0; k < used; ++k)
+				{
+					if (!src[k])
+						continue;
+					if (dst[k] & (src[k] << b))
+						return r;
+					if (b && (dst[k + 1] & (src[k] >> (64 - b))))
+						return r;
+				}
+			}
+			return other._height;
+		}
+		void stamp(const BitMask& other, const unsigned int x, const unsigned int y)
+		{
+			const unsigned int q = x >> 6, b = x & 63;
+			const unsigned int used = (other._width + 63) / 64;
+			for (unsigned int r = 0; r < other._height; ++r)
+			{
+				sf::Uint64* dst = row(y + r) + q;
+				const sf::Uint64* src = other.row(r);
+				for (unsigned int k = 0; k < used; ++k)
+				{
+					dst[k] |= src[k] << b;
+					if (b)
+						dst[k + 1] |= src[k] >> (64 - b);
+				}
+			}
+		}
+	};
+
+	// downsampled occupancy of an image, a cell is set when any of its pixels has alpha above the threshold
+	// occupied cells are grown by dilate cells to the right and bottom, the same way margins extend rects
+	BitMask buildAlphaMask(const sf::Uint8* pixels, const sf::Vector2u& size, const unsigned int cellSize, const sf::Uint8 threshold, const unsigned int dilate = 0)
+	{
+		const unsigned int cw = (size.x + cellSize - 1) / cellSize, ch = (size.y + cellSize - 1) / cellSize;
+		BitMask mask(cw + dilate, ch + dilate);
+		const size_t stride = static_cast<size_t>(size.x) * 4;
+
+		for (unsigned int cy = 0; cy < ch; ++cy)
+		{
+			const unsigned int y0 = cy * cellSize, y1 = std::min(y0 + cellSize, size.y);
+			for (unsigned int cx = 0; cx < cw; ++cx)
+			{
+				const unsigned int x0 = cx * cellSize, x1 = std::min(x0 + cellSize, size.x);
+				for (unsigned int y = y0; y < y1; ++y)
+					if (_anyAlphaAbove(pixels + y * stride + x0 * 4, x1 - x0, threshold))
+					{
+						for (unsigned int dy = 0; dy <= dilate; ++dy)
+							for (unsigned int dx = 0; dx <= dilate; ++dx)
+								mask.set(cx + dx, cy + dy);
+						break;
+					}
+			}
+		}
+		return mask;
+	}
+
+	// convex hull (clockwise in image space) around every pixel with alpha above the threshold
+	std::vector<sf::Vector2i> findAlphaHull(const sf::Uint8* pixels, const sf::Vector2u& size, const sf::Uint8 threshold)
+	{
+		const size_t stride = static_cast<size_t>(size.x) * 4;
+		std::vector<sf::Vector2i> points;
+		for (unsigned int y = 0; y < size.y; ++y)
+		{
+			const sf::Uint8* row = pixels + y * stride;
+			const unsigned int first = _firstAlphaAbove(row, size.x, threshold);
+			if (first == size.x)
+				continue;
+			const unsigned int last = _lastAlphaAbove(row, size.x, threshold);
+			points.emplace_back(first, y);
+			points.emplace_back(last + 1, y);
+			points.emplace_back(first, y + 1);
+			points.emplace_back(last + 1, y + 1);
+		}
+		if (points.size() < 3)
+			return points;
+
+		// monotone chain
+		std::sort(points.begin(), points.end(), [](const sf::Vector2i& a, const sf::Vector2i& b) { return a.x < b.x || (a.x == b.x && a.y < b.y); });
+		const auto cross = [](const sf::Vector2i& o, const sf::Vector2i& a, const sf::Vector2i& b)
+		{
+			return static_cast<long long>(a.x - o.x) * (b.y - o.y) - static_cast<long long>(a.y - o.y) * (b.x - o.x);
+		};
+
+		std::vector<sf::Vector2i> hull(points.size() * 2);
+		size_t k = 0;
+		for (size_t i = 0; i < points.size(); ++i)
+		{
+			while (k >= 2 && cross(hull[k - 2], hull[k - 1], points[i]) <= 0)
+				--k;
+			hull[k++] = points[i];
+		}
+		for (size_t i = points.size() - 1, t = k + 1; i > 0; --i)
+		{
+			while (k >= t && cross(hull[k - 2], hull[k - 1], points[i - 1]) <= 0)
+				--k;
+			hull[k++] = points[i - 1];
+		}
+		hull.resize(k - 1);
+		return hull;
+	}
+
+	sf::Uint32 crc32(sf::Uint32 crc, const sf::Uint8* data, const size_t length)
+	{
+		static const struct Table
+		{
+			sf::Uint32 entries[256];
+
+			Table()
+			{
+				for (sf::Uint32 i = 0; i < 256; ++i)
+				{
+					sf::Uint32 c = i;
+					for (int k = 0; k < 8; ++k)
+						c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+					entries[i] = c;
+				}
+			}
+		} table;
+
+		crc = ~crc;
+		for (size_t i = 0; i < length; ++i)
+			crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+		return ~crc;
+	}
+	sf::Uint32 adler32(const sf::Uint32 adler, const sf::Uint8* data, size_t length)
+	{
+		sf::Uint32 a = adler & 0xFFFF, b = adler >> 16;
+		while (length)
+		{
+			// 5552 is the longest run that can't overflow before the modulo
+			const size_t run = std::min<size_t>(length, 5552);
+			for (size_t i = 0; i < run; ++i)
+			{
+				a += data[i];
+				b += a;
+			}
+			a %= 65521;
+			b %= 65521;
+			data += run;
+			length -= run;
+		}
+		return b << 16 | a;
+	}
+
+	class BitWriter
+	{
+		std::vector<sf::Uint8>& _out;
+		sf::Uint64 _bits = 0;
+		unsigned int _count = 0;
+
+	public:
+		BitWriter(std::vector<sf::Uint8>& out) :
+			_out(out)
+		{}
+
+		// least significant bit first, the way deflate packs everything but huffman codes (those are stored reversed)
+		inline void put(const sf::Uint32 value, const unsigned int length)
+		{
+			_bits |= static_cast<sf::Uint64>(value) << _count;
+			_count += length;
+			while (_count >= 8)
+			{
+				_out.push_back(static_cast<sf::Uint8>(_bits));
+				_bits >>= 8;
+				_count -= 8;
+			}
+		}
+		inline void align()
+		{
+			if (_count)
+				put(0, 8 - _count);
+		}
+		inline void putBytes(const sf::Uint8* data, const size_t length)
+		{
+			align();
+			_out.insert(_out.end(), data, data + length);
+		}
+	};
+
+	// code lengths of a huffman code limited to maxLength bits, unused symbols get 0
+	void _huffmanLengths(const unsigned int* frequencies, const size_t count, const unsigned int maxLength, sf::Uint8* lengths)
+	{
+		std::vector<unsigned int> used;
+		for (size_t i = 0; i < count; ++i)
+		{
+			lengths[i] = 0;
+			if (frequencies[i])
+				used.push_back(static_cast<unsigned int>(i));
+		}
+		if (used.size() < 2)
+		{
+			if (used.size())
+				lengths[used[0]] = 1;
+			return;
+		}
+
+		// plain huffman tree, leaves first and internal nodes in the order they are made so the root is last
+		const size_t leaves = used.size();
+		std::vector<sf::Uint64> weight(2 * leaves - 1);
+		std::vector<size_t> parent(2 * leaves - 1, 0);
+		std::priority_queue<std::pair<sf::Uint64, size_t>, std::vector<std::pair<sf::Uint64, size_t>>, std::greater<std::pair<sf::Uint64, size_t>>> queue;
+		for (size_t i = 0; i < leaves; ++i)
+			queue.push(std::make_pair(weight[i] = frequencies[used[i]], i));
+		for (size_t node = leaves; node < weight.size(); ++node)
+		{
+			const std::pair<sf::Uint64, size_t> a = queue.top();
+			queue.pop();
+			const std::pair<sf::Uint64, size_t> b = queue.top();
+			queue.pop();
+			parent[a.second] = parent[b.second] = node;
+			queue.push(std::make_pair(weight[node] = a.first + b.first, node));
+		}
+		std::vector<unsigned int> depth(weight.size(), 0);
+		std::vector<unsigned int> lengthCount(leaves + 1, 0);
+		for (size_t node = weight.size() - 1; node-- > 0;)
+		{
+			depth[node] = depth[parent[node]] + 1;
+			if (node < leaves)
+				++lengthCount[depth[node]];
+		}
+
+		// too deep leaves are moved up in pairs, each pair takes the place of a shallower leaf that moves one level down
+		for (size_t i = leaves; i > maxLength; --i)
+			while (lengthCount[i])
+			{
+				size_t j = i - 2;
+				while (!lengthCount[j])
+					--j;
+				lengthCount[i] -= 2;
+				++lengthCount[i - 1];
+				lengthCount[j + 1] += 2;
+				--lengthCount[j];
+			}
+
+		// the most frequent symbols take the shortest codes
+		std::stable_sort(used.begin(), used.end(), [&](const unsigned int a, const unsigned int b) { return frequencies[a] > frequencies[b]; });
+		size_t next = 0;
+		for (unsigned int length = 1; length <= maxLength && length < lengthCount.size(); ++length)
+			for (unsigned int k = 0; k < lengthCount[length]; ++k)
+				lengths[used[next++]] = static_cast<sf::Uint8>(length);
+	}
+	// canonical codes, bit reversed so they can go through BitWriter::put
+	void _huffmanCodes(const sf::Uint8* lengths, const size_t count, sf::Uint16* codes)
+	{
+		unsigned int lengthCount[16] = { 0 }, next[16] = { 0 };
+		for (size_t i = 0; i < count; ++i)
+			++lengthCount[lengths[i]];
+		lengthCount[0] = 0;
+		for (unsigned int length = 1, code = 0; length < 16; ++length)
+			next[length] = code = (code + lengthCount[length - 1]) << 1;
+		for (size_t i = 0; i < count; ++i)
+		{
+			codes[i] = 0;
+			if (!lengths[i])
+				continue;
+			const unsigned int code = next[lengths[i]]++;
+			for (unsigned int b = 0; b < lengths[i]; ++b)
+				codes[i] |= ((code >> b) & 1) << (lengths[i] - 1 - b);
+		}
+	}
+
+	class _DeflateTables
+	{
+	public:
+		sf::Uint8 lengthCode[259], lengthExtra[29], distanceExtra[30];
+		sf::Uint16 lengthBase[29], distanceBase[30];
+
+		_DeflateTables()
+		{
+			for (unsigned int code = 0, base = 3; code < 28; ++code)
+			{
+				lengthExtra[code] = static_cast<sf::Uint8>(code < 8 ? 0 : (code - 4) / 4);
+				lengthBase[code] = static_cast<sf::Uint16>(base);
+				for (unsigned int i = 0; i < (1u << lengthExtra[code]); ++i)
+					lengthCode[base + i] = static_cast<sf::Uint8>(code);
+				base += 1 << lengthExtra[code];
+			}
+			lengthExtra[28] = 0;
+			lengthBase[28] = 258;
+			lengthCode[258] = 28;
+			for (unsigned int code = 0, base = 1; code < 30; ++code)
+			{
+				distanceExtra[code] = static_cast<sf::Uint8>(code < 4 ? 0 : (code - 2) / 2);
+				distanceBase[code] = static_cast<sf::Uint16>(base);
+				base += 1 << distanceExtra[code];
+			}
+		}
+
+		inline unsigned int distanceCode(const unsigned int distance) const
+		{
+			unsigned int code = 0;
+			while (code < 29 && distanceBase[code + 1] <= distance)
+				++code;
+			return code;
+		}
+
+		static const _DeflateTables& get()
+		{
+			static const _DeflateTables tables;
+			return tables;
+		}
+	};
+
+	// a literal (distance 0) or a match
+	class _DeflateToken
+	{
+	public:
+		sf::Uint16 value, distance;
+	};
+
+	void _writeDynamicBlock(BitWriter& out, const std::vector<_DeflateToken>& tokens, const bool final)
+	{
+		const _DeflateTables& tables = _DeflateTables::get();
+		unsigned int literalFrequencies[286] = { 0 }, distanceFrequencies[30] = { 0 };
+		for (size_t i = 0; i < tokens.size(); ++i)
+			if (tokens[i].distance)
+			{
+				++literalFrequencies[257 + tables.lengthCode[tokens[i].value]];
+				++distanceFrequencies[tables.distanceCode(tokens[i].distance)];
+			}
+			else
+				++literalFrequencies[tokens[i].value];
+		literalFrequencies[256] = 1;
+		// single code trees are rejected by some inflaters, two symbols are always there
+		if (!literalFrequencies[0])
+			literalFrequencies[0] = 1;
+		distanceFrequencies[0] += !distanceFrequencies[0];
+		distanceFrequencies[1] += !distanceFrequencies[1];
+
+		sf::Uint8 lengths[286 + 30];
+		sf::Uint16 literalCodes[286], distanceCodes[30];
+		_huffmanLengths(literalFrequencies, 286, 15, lengths);
+		_huffmanLengths(distanceFrequencies, 30, 15, lengths + 286);
+		_huffmanCodes(lengths, 286, literalCodes);
+		_huffmanCodes(lengths + 286, 30, distanceCodes);
+
+		unsigned int literalCount = 286, distanceCount = 30;
+		while (literalCount > 257 && !lengths[literalCount - 1])
+			--literalCount;
+		while (distanceCount > 1 && !lengths[286 + distanceCount - 1])
+			--distanceCount;
+
+		// the code lengths themselves are run length coded with symbols 16 (repeat), 17 and 18 (zeros)
+		std::vector<sf::Uint8> all(lengths, lengths + literalCount);
+		all.insert(all.end(), lengths + 286, lengths + 286 + distanceCount);
+		std::vector<std::pair<sf::Uint8, sf::Uint8>> runs;
+		for (size_t i = 0; i < all.size();)
+		{
+			size_t run = 1;
+			while (i + run < all.size() && all[i + run] == all[i])
+				++run;
+			if (!all[i] && run >= 3)
+			{
+				run = std::min<size_t>(run, 138);
+				runs.push_back(run >= 11 ? std::make_pair<sf::Uint8, sf::Uint8>(18, static_cast<sf::Uint8>(run - 11)) : std::make_pair<sf::Uint8, sf::Uint8>(17, static_cast<sf::Uint8>(run - 3)));
+			}
+			else if (all[i] && run >= 4)
+			{
+				run = std::min<size_t>(run, 7);
+				runs.push_back(std::make_pair<sf::Uint8, sf::Uint8>(static_cast<sf::Uint8>(all[i]), 0));
+				runs.push_back(std::make_pair<sf::Uint8, sf::Uint8>(16, static_cast<sf::Uint8>(run - 4)));
+			}
+			else
+			{
+				run = 1;
+				runs.push_back(std::make_pair<sf::Uint8, sf::Uint8>(static_cast<sf::Uint8>(all[i]), 0));
+			}
+			i += run;
+		}
+
+		unsigned int lengthFrequencies[19] = { 0 };
+		for (size_t i = 0; i < runs.size(); ++i)
+			++lengthFrequencies[runs[i].first];
+		sf::Uint8 lengthLengths[19];
+		sf::Uint16 lengthCodes[19];
+		_huffmanLengths(lengthFrequencies, 19, 7, lengthLengths);
+		_huffmanCodes(lengthLengths, 19, lengthCodes);
+
+		static const sf::Uint8 order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+		unsigned int lengthCount = 19;
+		while (lengthCount > 4 && !lengthLengths[order[lengthCount - 1]])
+			--lengthCount;
+
+		out.put(final, 1);
+		out.put(2, 2);
+		out.put(literalCount - 257, 5);
+		out.put(distanceCount - 1, 5);
+		out.put(lengthCount - 4, 4);
+		for (unsigned int i = 0; i < lengthCount; ++i)
+			out.put(lengthLengths[order[i]], 3);
+		for (size_t i = 0; i < runs.size(); ++i)
+		{
+			out.put(lengthCodes[runs[i].first], lengthLengths[runs[i].first]);
+			if (runs[i].first >= 16)
+				out.put(runs[i].second, runs[i].first == 16 ? 2 : runs[i].first == 17 ? 3 : 7);
+		}
+
+		for (size_t i = 0; i < tokens.size(); ++i)
+		{
+			const _DeflateToken& token = tokens[i];
+			if (!token.distance)
+			{
+				out.put(literalCodes[token.value], lengths[token.value]);
+				continue;
+			}
+			const unsigned int lengthCode = tables.lengthCode[token.value], distanceCode = tables.distanceCode(token.distance);
+			out.put(literalCodes[257 + lengthCode], lengths[257 + lengthCode]);
+			out.put(token.value - tables.lengthBase[lengthCode], tables.lengthExtra[lengthCode]);
+			out.put(distanceCodes[distanceCode], lengths[286 + distanceCode]);
+			out.put(token.distance - tables.distanceBase[distanceCode], tables.distanceExtra[distanceCode]);
+		}
+		out.put(literalCodes[256], lengths[256]);
+	}
+
+	// compresses length bytes of data as a run of deflate blocks, matches may reach back into the dictionary bytes right before data
+	// the output always ends on a byte boundary, after the final block or after an empty stored block (a sync flush) when more follows
+	// level 0 stores, 1 to 9 trade speed for longer match searches
+	void deflateSegment(const sf::Uint8* data, const size_t length, size_t dictionary, const bool last, const int level, std::vector<sf::Uint8>& output)
+	{
+		BitWriter out(output);
+
+		if (level <= 0)
+		{
+			size_t done = 0;
+			do
+			{
+				const size_t block = std::min<size_t>(length - done, 65535);
+				const bool final = last && done + block == length;
+				out.put(final, 1);
+				out.put(0, 2);
+				out.align();
+				out.put(static_cast<sf::Uint32>(block), 16);
+				out.put(static_cast<sf::Uint32>(~block & 0xFFFF), 16);
+				out.putBytes(data + done, block);
+				done += block;
+			} while (done < length);
+			if (!last)
+			{
+				out.put(0, 3);
+				out.align();
+				out.put(0, 16);
+				out.put(0xFFFF, 16);
+			}
+			return;
+		}
+
+		static const unsigned int chains[10] = { 0, 4, 8, 16, 32, 64, 128, 256, 1024, 4096 };
+		static const unsigned int niceLengths[10] = { 0, 8, 16, 32, 64, 128, 128, 258, 258, 258 };
+		const unsigned int maxChain = chains[std::min(level, 9)], niceLength = niceLengths[std::min(level, 9)];
+		const bool lazy = level >= 4;
+
+		dictionary = std::min<size_t>(dictionary, 32768);
+		const sf::Uint8* window = data - dictionary;
+		const size_t total = dictionary + length;
+		const unsigned int hashBits = 15;
+		std::vector<sf::Int32> head(1 << hashBits, -1), previous(total);
+		const auto hash = [&](const size_t at) { return ((window[at] << 10) ^ (window[at + 1] << 5) ^ window[at + 2]) & ((1 << hashBits) - 1); };
+		const auto insert = [&](const size_t at)
+		{
+			if (at + 2 < total)
+			{
+				const unsigned int h = hash(at);
+				previous[at] = head[h];
+				head[h] = static_cast<sf::Int32>(at);
+			}
+		};
+		const auto longest = [&](const size_t at, unsigned int& distance)
+		{
+			unsigned int best = 0;
+			if (at + 2 >= total)
+				return best;
+			const unsigned int limit = static_cast<unsigned int>(std::min<size_t>(258, total - at));
+			sf::Int32 candidate = head[hash(at)];
+			for (unsigned int chain = 0; candidate >= 0 && at - candidate <= 32768 && chain < maxChain; ++chain, candidate = previous[candidate])
+			{
+				const sf::Uint8* a = window + at;
+				const sf::Uint8* b = window + candidate;
+				if (best == limit)
+					break;
+				if (b[best] != a[best])
+					continue;
+				unsigned int matched = 0;
+				while (matched < limit && a[matched] == b[matched])
+					++matched;
+				if (matched > best)
+				{
+					best = matched;
+					distance = static_cast<unsigned int>(at - candidate);
+					if (best >= niceLength)
+						break;
+				}
+			}
+			return best >= 3 ? best : 0;
+		};
+
+		// positions go into the hash chains once, in order
+		size_t inserted = 0;
+		const auto insertUpTo = [&](const size_t end)
+		{
+			for (; inserted < end; ++inserted)
+				insert(inserted);
+		};
+		insertUpTo(dictionary);
+
+		// blocks are closed every so many tokens so the huffman codes follow the data
+		const size_t blockTokens = 1 << 15;
+		std::vector<_DeflateToken> tokens;
+		tokens.reserve(blockTokens);
+		size_t at = dictionary;
+		while (at < total)
+		{
+			unsigned int distance = 0;
+			unsigned int matched = longest(at, distance);
+
+			// lazy matching, a literal is cheaper when the next position starts a longer match
+			if (matched && lazy && matched < niceLength)
+			{
+				unsigned int nextDistance = 0;
+				insertUpTo(at + 1);
+				if (longest(at + 1, nextDistance) > matched)
+					matched = 0;
+			}
+
+			if (matched)
+			{
+				tokens.push_back(_DeflateToken{ static_cast<sf::Uint16>(matched), static_cast<sf::Uint16>(distance) });
+				at += matched;
+			}
+			else
+			{
+				tokens.push_back(_DeflateToken{ window[at], 0 });
+				++at;
+			}
+			insertUpTo(at);
+
+			if (tokens.size() >= blockTokens && at < total)
+			{
+				_writeDynamicBlock(out, tokens, false);
+				tokens.clear();
+			}
+		}
+		_writeDynamicBlock(out, tokens, last);
+
+		if (last)
+			out.align();
+		else
+		{
+			out.put(0, 3);
+			out.align();
+			out.put(0, 16);
+			out.put(0xFFFF, 16);
+		}
+	}
+
+	enum class TextureFormat
+	{
+		RGBA8,
+		BC1,
+		BC3,
+		BC7,
+		RGB8,
+		RGB565,
+		RGBA4444,
+		RGBA5551,
+		A8,
+		L8
+	};
+
+	inline const char* formatName(const TextureFormat format)
+	{
+		static const char* const names[] = { "rgba8", "bc1", "bc3", "bc7", "rgb8", "rgb565", "rgba4444", "rgba5551", "a8", "l8" };
+		return names[static_cast<size_t>(format)];
+	}
+	inline bool isBlockCompressed(const TextureFormat format)
+	{
+		return format == TextureFormat::BC1 || format == TextureFormat::BC3 || format == TextureFormat::BC7;
+	}
+	// bytes of a 4x4 block, or of a pixel for uncompressed data
+	inline size_t blockBytes(const TextureFormat format)
+	{
+		switch (format)
+		{
+		case TextureFormat::BC1: return 8;
+		case TextureFormat::BC3: return 16;
+		case TextureFormat::BC7: return 16;
+		case TextureFormat::RGB8: return 3;
+		case TextureFormat::RGB565:
+		case TextureFormat::RGBA4444:
+		case TextureFormat::RGBA5551: return 2;
+		case TextureFormat::A8:
+		case TextureFormat::L8: return 1;
+		default: return 4;
+		}
+	}
+	// bits the format keeps of each channel, 0 for channels it drops
+	inline void channelBits(const TextureFormat format, int bits[4])
+	{
+		static const int table[][4] = { { 8, 8, 8, 8 }, { 8, 8, 8, 8 }, { 8, 8, 8, 8 }, { 8, 8, 8, 8 },
+			{ 8, 8, 8, 0 }, { 5, 6, 5, 0 }, { 4, 4, 4, 4 }, { 5, 5, 5, 1 }, { 0, 0, 0, 8 }, { 8, 8, 8, 0 } };
+		std::copy(table[static_cast<size_t>(format)], table[static_cast<size_t>(format)] + 4, bits);
+	}
+
+	// n bit value <-> 8 bits, rounding to the nearest level and expanding back up by bit replication
+	inline int _levelCount(const int bits) { return bits ? (1 << bits) - 1 : 255; }
+	inline int _expandFactor(const int bits)
+	{
+		// q * factor >> 4 replicates the bits of q: 4 -> q * 17, 5 -> (q << 3 | q >> 2), 6 -> (q << 2 | q >> 4)
+		switch (bits)
+		{
+		case 1: return 4080;
+		case 4: return 272;
+		case 5: return 132;
+		case 6: return 65;
+		default: return 16;
+		}
+	}
+	inline int _quantizeChannel(const int value, const int bits)
+	{
+		return (value * _levelCount(bits) + 127) / 255;
+	}
+
+	enum class Dither
+	{
+		None,
+		Ordered,
+		Diffusion
+	};
+
+	// brings rows down to the precision of the output format and back up to 8 bits a channel, in place,
+	// so every writer (and the suggestion below) sees exactly what the GPU will sample
+	class PrecisionReducer
+	{
+		TextureFormat _format;
+		Dither _dither;
+		unsigned int _width, _row = 0;
+		int _bits[4];
+		// floyd-steinberg error of this row and the next one, in 16ths, with a pixel of padding on both sides
+		std::vector<int> _errors, _nextErrors;
+
+		void _toLuminance(sf::Uint8* row) const
+		{
+			for (unsigned int x = 0; x < _width; ++x)
+			{
+				sf::Uint8* p = row + x * 4;
+				p[0] = p[1] = p[2] = static_cast<sf::Uint8>((77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8);
+			}
+		}
+		// four pixels at a time, threshold t added before the division by 255 (127 rounds, the bayer matrix dithers)
+		void _quantizeRow(sf::Uint8* row) const
+		{
+			static const int bayer[4][4] = { { 0, 8, 2, 10 }, { 12, 4, 14, 6 }, { 3, 11, 1, 9 }, { 15, 7, 13, 5 } };
+			int t[4];
+			for (size_t x = 0; x < 4; ++x)
+				t[x] = _dither == Dither::Ordered ? bayer[_row & 3][x] * 16 + 8 : 127;
+
+			const __m128i levels = _mm_setr_epi16(_levelCount(_bits[0]), _levelCount(_bits[1]), _levelCount(_bits[2]), _levelCount(_bits[3]),
+				_levelCount(_bits[0]), _levelCount(_bits[1]), _levelCount(_bits[2]), _levelCount(_bits[3]));
+			const __m128i expand = _mm_setr_epi16(_expandFactor(_bits[0]), _expandFactor(_bits[1]), _expandFactor(_bits[2]), _expandFactor(_bits[3]),
+				_expandFactor(_bits[0]), _expandFactor(_bits[1]), _expandFactor(_bits[2]), _expandFactor(_bits[3]));
+			const __m128i low = _mm_setr_epi16(t[0], t[0], t[0], t[0], t[1], t[1], t[1], t[1]);
+			const __m128i high = _mm_setr_epi16(t[2], t[2], t[2], t[2], t[3], t[3], t[3], t[3]);
+			const __m128i zero = _mm_setzero_si128(), one = _mm_set1_epi16(1);
+			const auto quantize = [&](__m128i v, const __m128i threshold)
+			{
+				// x / 255 == (x + 1 + (x >> 8)) >> 8 for every x this can produce
+				v = _mm_add_epi16(_mm_mullo_epi16(v, levels), threshold);
+				v = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(v, one), _mm_srli_epi16(v, 8)), 8);
+				return _mm_srli_epi16(_mm_mullo_epi16(v, expand), 4);
+			};
+
+			unsigned int x = 0;
+			for (; x + 4 <= _width; x += 4)
+			{
+				const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x * 4));
+				const __m128i a = quantize(_mm_unpacklo_epi8(v, zero), low), b = quantize(_mm_unpackhi_epi8(v, zero), high);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(row + x * 4), _mm_packus_epi16(a, b));
+			}
+			for (; x < _width; ++x)
+				for (size_t c = 0; c < 4; ++c)
+				{
+					const int q = (row[x * 4 + c] * _levelCount(_bits[c]) + t[x & 3]) / 255;
+					row[x * 4 + c] = static_cast<sf::Uint8>(q * _expandFactor(_bits[c]) >> 4);
+				}
+		}
+		void _diffuseRow(sf::Uint8* row)
+		{
+			std::fill(_nextErrors.begin(), _nextErrors.end(), 0);
+			for (unsigned int x = 0; x < _width; ++x)
+				for (size_t c = 0; c < 4; ++c)
+				{
+					const size_t i = (x + 1) * 4 + c;
+					const int value = std::min(255, std::max(0, row[x * 4 + c] + _errors[i] / 16));
+					const int expanded = _quantizeChannel(value, _bits[c]) * _expandFactor(_bits[c]) >> 4;
+					const int error = value - expanded;
+					row[x * 4 + c] = static_cast<sf::Uint8>(expanded);
+					_errors[i + 4] += 7 * error;
+					_nextErrors[i - 4] += 3 * error;
+					_nextErrors[i] += 5 * error;
+					_nextErrors[i + 4] += error;
+				}
+			std::swap(_errors, _nextErrors);
+		}
+
+	public:
+		PrecisionReducer(const TextureFormat format, const Dither dither, const unsigned int width) :
+			_format(format),
+			_dither(dither),
+			_width(width)
+		{
+			channelBits(format, _bits);
+			if (dither == Dither::Diffusion)
+			{
+				_errors.resize((static_cast<size_t>(width) + 2) * 4, 0);
+				_nextErrors.resize(_errors.size(), 0);
+			}
+		}
+
+		// 8 bit RGBA and the block formats (which do their own fitting) pass through untouched
+		inline bool isIdentity() const
+		{
+			return _format == TextureFormat::RGBA8 || isBlockCompressed(_format);
+		}
+
+		void apply(sf::Uint8* rows, const unsigned int count)
+		{
+			if (isIdentity())
+				return;
+
+			for (unsigned int y = 0; y < count; ++y, ++_row)
+			{
+				sf::Uint8* row = rows + static_cast<size_t>(y) * _width * 4;
+				if (_format == TextureFormat::L8)
+					_toLuminance(row);
+				if (_dither == Dither::Diffusion)
+					_diffuseRow(row);
+				else
+					_quantizeRow(row);
+
+				// dropped channels read back as opaque, or as black for alpha only formats
+				for (unsigned int x = 0; x < _width; ++x)
+				{
+					if (!_bits[3])
+						row[x * 4 + 3] = 255;
+					if (!_bits[0])
+						row[x * 4] = row[x * 4 + 1] = row[x * 4 + 2] = 0;
+				}
+			}
+		}
+	};
+
+	// watches the composed rows for the smallest format that would store them without loss
+	class FormatSurvey
+	{
+		bool _opaque = true, _grey = true, _alphaOnly = true, _fits565 = true, _fits4444 = true, _fits5551 = true;
+
+		static inline bool _exact(const int value, const int bits)
+		{
+			return (_quantizeChannel(value, bits) * _expandFactor(bits) >> 4) == value;
+		}
+
+	public:
+		void add(const sf::Uint8* rows, const size_t pixels)
+		{
+			for (size_t i = 0; i < pixels; ++i)
+			{
+				const sf::Uint8* p = rows + i * 4;
+				_opaque = _opaque && p[3] == 255;
+				_grey = _grey && p[0] == p[1] && p[1] == p[2];
+				_alphaOnly = _alphaOnly && !p[0] && !p[1] && !p[2];
+				_fits565 = _fits565 && _exact(p[0], 5) && _exact(p[1], 6) && _exact(p[2], 5);
+				_fits4444 = _fits4444 && _exact(p[0], 4) && _exact(p[1], 4) && _exact(p[2], 4) && _exact(p[3], 4);
+				_fits5551 = _fits5551 && _exact(p[0], 5) && _exact(p[1], 5) && _exact(p[2], 5) && (p[3] == 0 || p[3] == 255);
+			}
+		}
+		TextureFormat suggest() const
+		{
+			if (_alphaOnly)
+				return TextureFormat::A8;
+			if (_opaque && _grey)
+				return TextureFormat::L8;
+			if (_opaque && _fits565)
+				return TextureFormat::RGB565;
+			if (_fits4444)
+				return TextureFormat::RGBA4444;
+			if (_fits5551)
+				return TextureFormat::RGBA5551;
+			if (_opaque)
+				return TextureFormat::RGB8;
+			return TextureFormat::RGBA8;
+		}
+	};
+
+	// transfer function applied to the colour on export, alpha is always left linear
+	enum class Transfer
+	{
+		Unchanged,
+		ToLinear,
+		ToSrgb
+	};
+
+	inline const char* transferName(const Transfer transfer)
+	{
+		return transfer == Transfer::ToLinear ? "linear" : transfer == Transfer::ToSrgb ? "srgb" : "source";
+	}
+
+	// converts straight 8 bit colour to the space the renderer samples in, then premultiplies it by alpha,
+	// the transfer is a table lookup and the premultiply four pixels at a time
+	class ColorConverter
+	{
+		bool _premultiply;
+		Transfer _transfer;
+		sf::Uint8 _table[256];
+
+	public:
+		ColorConverter(const bool premultiply = false, const Transfer transfer = Transfer::Unchanged) :
+			_premultiply(premultiply),
+			_transfer(transfer)
+		{
+			for (int i = 0; i < 256; ++i)
+			{
+				const double c = i / 255.0;
+				double v = c;
+				if (transfer == Transfer::ToLinear)
+					v = c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+				else if (transfer == Transfer::ToSrgb)
+					v = c <= 0.0031308 ? c * 12.92 : 1.055 * std::pow(c, 1.0 / 2.4) - 0.055;
+				_table[i] = static_cast<sf::Uint8>(std::lround(v * 255.0));
+			}
+		}
+
+		inline bool isIdentity() const { return !_premultiply && _transfer == Transfer::Unchanged; }
+		inline bool isPremultiplied() const { return _premultiply; }
+		inline Transfer getTransfer() const { return _transfer; }
+		// what the texture headers should declare, the source is taken to be sRGB
+		inline bool isLinear() const { return _transfer == Transfer::ToLinear; }
+
+		void apply(sf::Uint8* pixels, const size_t count) const
+		{
+			if (_transfer != Transfer::Unchanged)
+				for (size_t i = 0; i < count; ++i)
+				{
+					sf::Uint8* p = pixels + i * 4;
+					p[0] = _table[p[0]];
+					p[1] = _table[p[1]];
+					p[2] = _table[p[2]];
+				}
+			if (!_premultiply)
+				return;
+
+			// c * a / 255 rounded is (t + (t >> 8)) >> 8 with t = c * a + 128, alpha is multiplied by 255 to keep it
+			const __m128i zero = _mm_setzero_si128(), half = _mm_set1_epi16(128);
+			const __m128i alphaLane = _mm_setr_epi16(0, 0, 0, -1, 0, 0, 0, -1), keepAlpha = _mm_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255);
+			const auto premultiply = [&](const __m128i v)
+			{
+				__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+				a = _mm_or_si128(_mm_andnot_si128(alphaLane, a), keepAlpha);
+				const __m128i t = _mm_add_epi16(_mm_mullo_epi16(v, a), half);
+				return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+			};
+
+			size_t i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i * 4));
+				const __m128i lo = premultiply(_mm_unpacklo_epi8(v, zero)), hi = premultiply(_mm_unpackhi_epi8(v, zero));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + i * 4), _mm_packus_epi16(lo, hi));
+			}
+			for (; i < count; ++i)
+			{
+				sf::Uint8* p = pixels + i * 4;
+				for (size_t c = 0; c < 3; ++c)
+				{
+					const int t = p[c] * p[3] + 128;
+					p[c] = static_cast<sf::Uint8>((t + (t >> 8)) >> 8);
+				}
+			}
+		}
+	};
+
+	// uncompressed texels in the layout of the matching Vulkan / DXGI format
+	void packPixels(const TextureFormat format, const sf::Uint8* pixels, const size_t count, sf::Uint8* out)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			const sf::Uint8* p = pixels + i * 4;
+			sf::Uint16 packed = 0;
+			switch (format)
+			{
+			case TextureFormat::RGB8:
+				std::memcpy(out + i * 3, p, 3);
+				continue;
+			case TextureFormat::A8:
+				out[i] = p[3];
+				continue;
+			case TextureFormat::L8:
+				out[i] = p[0];
+				continue;
+			case TextureFormat::RGB565:
+				packed = static_cast<sf::Uint16>(_quantizeChannel(p[0], 5) << 11 | _quantizeChannel(p[1], 6) << 5 | _quantizeChannel(p[2], 5));
+				break;
+			case TextureFormat::RGBA4444:
+				packed = static_cast<sf::Uint16>(_quantizeChannel(p[0], 4) << 12 | _quantizeChannel(p[1], 4) << 8 | _quantizeChannel(p[2], 4) << 4 | _quantizeChannel(p[3], 4));
+				break;
+			case TextureFormat::RGBA5551:
+				packed = static_cast<sf::Uint16>(_quantizeChannel(p[0], 5) << 11 | _quantizeChannel(p[1], 5) << 6 | _quantizeChannel(p[2], 5) << 1 | _quantizeChannel(p[3], 1));
+				break;
+			default:
+				std::memcpy(out + i * 4, p, 4);
+				continue;
+			}
+			out[i * 2] = static_cast<sf::Uint8>(packed);
+			out[i * 2 + 1] = static_cast<sf::Uint8>(packed >> 8);
+		}
+	}
+
+	// channels an 8 bit image file keeps for the format: grey, RGB or RGBA
+	inline size_t pixelChannels(const TextureFormat format)
+	{
+		int bits[4];
+		channelBits(format, bits);
+		return format == TextureFormat::A8 || format == TextureFormat::L8 ? 1 : bits[3] ? 4 : 3;
+	}
+	void selectChannels(const TextureFormat format, const sf::Uint8* pixels, const size_t count, sf::Uint8* out)
+	{
+		const size_t channels = pixelChannels(format), first = format == TextureFormat::A8 ? 3 : 0;
+		for (size_t i = 0; i < count; ++i)
+			for (size_t c = 0; c < channels; ++c)
+				out[i * channels + c] = pixels[i * 4 + first + c];
+	}
+
+	// receives an image top to bottom, a band of rows at a time, so the whole image never has to be in memory
+	class ImageWriter
+	{
+	public:
+		virtual ~ImageWriter() {}
+
+		// rows are tightly packed RGBA
+		virtual bool writeRows(const sf::Uint8* rows, const unsigned int count) = 0;
+		virtual bool finish() = 0;
+	};
+
+	// rows are filtered and compressed on several threads, pigz style: every segment ends on a byte boundary
+	// and only looks back into the 32k before it, so the compressed segments chain into one zlib stream
+	class PngWriter : public ImageWriter
+	{
+		// amount of filtered data each thread compresses at once
+		static const size_t SegmentSize = 1 << 17;
+
+		std::ofstream _out;
+		sf::Vector2u _size;
+		int _level;
+		size_t _threads, _channels;
+		TextureFormat _format;
+		std::vector<sf::Uint8> _previous, _pending, _converted;
+		size_t _dictionary = 0;
+		sf::Uint32 _adler = 1;
+		bool _headerWritten = false;
+
+		void _put32(std::vector<sf::Uint8>& data, const sf::Uint32 value)
+		{
+			for (int shift = 24; shift >= 0; shift -= 8)
+				data.push_back(static_cast<sf::Uint8>(value >> shift));
+		}
+		void _chunk(const char* type, const std::vector<sf::Uint8>& data)
+		{
+			std::vector<sf::Uint8> head;
+			_put32(head, static_cast<sf::Uint32>(data.size()));
+			head.insert(head.end(), type, type + 4);
+			sf::Uint32 crc = crc32(0, head.data() + 4, 4);
+			crc = crc32(crc, data.data(), data.size());
+			std::vector<sf::Uint8> tail;
+			_put32(tail, crc);
+			_out.write(reinterpret_cast<const char*>(head.data()), head.size());
+			_out.write(reinterpret_cast<const char*>(data.data()), data.size());
+			_out.write(reinterpret_cast<const char*>(tail.data()), tail.size());
+		}
+		inline size_t _workers() const
+		{
+			return _threads ? _threads : std::max(1u, std::thread::hardware_concurrency());
+		}
+		// compresses everything after the dictionary, one IDAT per segment
+		void _compress(const bool last)
+		{
+			const size_t length = _pending.size() - _dictionary;
+			const size_t count = std::max<size_t>(1, (length + SegmentSize - 1) / SegmentSize);
+			std::vector<std::vector<sf::Uint8>> segments(count);
+			util::parallelFor(count, [&](const size_t s)
+			{
+				const size_t start = _dictionary + s * SegmentSize, end = std::min(start + SegmentSize, _pending.size());
+				deflateSegment(_pending.data() + start, end - start, std::min<size_t>(start, 32768), last && s + 1 == count, _level, segments[s]);
+			}, _threads);
+
+			for (size_t s = 0; s < count; ++s)
+			{
+				if (!_headerWritten)
+				{
+					const sf::Uint8 header[2] = { 0x78, 0x9C };
+					segments[s].insert(segments[s].begin(), header, header + 2);
+					_headerWritten = true;
+				}
+				if (last && s + 1 == count)
+					_put32(segments[s], _adler);
+				_chunk("IDAT", segments[s]);
+			}
+
+			const size_t keep = std::min<size_t>(_pending.size(), 32768);
+			_pending.erase(_pending.begin(), _pending.end() - keep);
+			_dictionary = keep;
+		}
+
+		static inline int _predict(const size_t filter, const int a, const int b, const int c)
+		{
+			switch (filter)
+			{
+			case 1: return a;
+			case 2: return b;
+			case 3: return (a + b) / 2;
+			case 4:
+			{
+				const int p = a + b - c, pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+				return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+			}
+			default: return 0;
+			}
+		}
+		// picks the filter with the smallest sum of absolute differences, the usual heuristic
+		static void _filterRow(const sf::Uint8* row, const sf::Uint8* up, sf::Uint8* out, const size_t length, const size_t bpp)
+		{
+			sf::Uint64 costs[5] = { 0 };
+			for (size_t i = 0; i < length; ++i)
+			{
+				const int a = i >= bpp ? row[i - bpp] : 0, b = up[i], c = i >= bpp ? up[i - bpp] : 0;
+				for (size_t f = 0; f < 5; ++f)
+					costs[f] += std::abs(static_cast<sf::Int8>(row[i] - _predict(f, a, b, c)));
+			}
+
+			const size_t best = std::min_element(costs, costs + 5) - costs;
+			out[0] = static_cast<sf::Uint8>(best);
+			for (size_t i = 0; i < length; ++i)
+			{
+				const int a = i >= bpp ? row[i - bpp] : 0, b = up[i], c = i >= bpp ? up[i - bpp] : 0;
+				out[i + 1] = static_cast<sf::Uint8>(row[i] - _predict(best, a, b, c));
+			}
+		}
+
+		void _writeHeader(const sf::Uint8 colorType)
+		{
+			static const sf::Uint8 signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+			_out.write(reinterpret_cast<const char*>(signature), 8);
+			std::vector<sf::Uint8> header;
+			_put32(header, _size.x);
+			_put32(header, _size.y);
+			// 8 bits per channel (or index), deflate, adaptive filtering, no interlace
+			const sf::Uint8 layout[5] = { 8, colorType, 0, 0, 0 };
+			header.insert(header.end(), layout, layout + 5);
+			_chunk("IHDR", header);
+		}
+		// rows already in the layout of the file
+		bool _writeFiltered(const sf::Uint8* rows, const unsigned int count)
+		{
+			if (!count)
+				return static_cast<bool>(_out);
+
+			const size_t stride = static_cast<size_t>(_size.x) * _channels, start = _pending.size();
+			_pending.resize(start + count * (stride + 1));
+			sf::Uint8* filtered = _pending.data() + start;
+			util::parallelFor(count, [&](const size_t y)
+			{
+				_filterRow(rows + y * stride, y ? rows + (y - 1) * stride : _previous.data(), filtered + y * (stride + 1), stride, _channels);
+			}, _threads);
+			_adler = adler32(_adler, filtered, count * (stride + 1));
+			std::memcpy(_previous.data(), rows + (count - 1) * stride, stride);
+
+			// enough is buffered to give every thread a full segment
+			if (_pending.size() - _dictionary >= SegmentSize * _workers())
+				_compress(false);
+			return static_cast<bool>(_out);
+		}
+
+	public:
+		// level goes from 0 (stored) to 9, threads 0 uses every core, formats without alpha or colour drop those channels
+		PngWriter(const std::string& path, const sf::Vector2u& size, const int level = 6, const size_t threads = 0, const TextureFormat format = TextureFormat::RGBA8) :
+			_out(path, std::ios::binary),
+			_size(size),
+			_level(level),
+			_threads(threads),
+			_channels(pixelChannels(format)),
+			_format(format),
+			_previous(static_cast<size_t>(size.x) * _channels, 0)
+		{
+			_writeHeader(static_cast<sf::Uint8>(_channels == 1 ? 0 : _channels == 3 ? 2 : 6));
+		}
+		// indexed image, palette holds RGBA entries, the translucent ones first
+		PngWriter(const std::string& path, const sf::Vector2u& size, const std::vector<sf::Uint8>& palette, const int level = 6, const size_t threads = 0) :
+			_out(path, std::ios::binary),
+			_size(size),
+			_level(level),
+			_threads(threads),
+			_channels(1),
+			_format(TextureFormat::RGBA8),
+			_previous(size.x, 0)
+		{
+			_writeHeader(3);
+
+			std::vector<sf::Uint8> colors, alphas;
+			for (size_t i = 0; i < palette.size(); i += 4)
+			{
+				colors.insert(colors.end(), palette.begin() + i, palette.begin() + i + 3);
+				if (palette[i + 3] != 255)
+					alphas.resize(i / 4 + 1, 255);
+				if (i / 4 < alphas.size())
+					alphas[i / 4] = palette[i + 3];
+			}
+			_chunk("PLTE", colors);
+			if (!alphas.empty())
+				_chunk("tRNS", alphas);
+		}
+
+		bool writeRows(const sf::Uint8* rows, const unsigned int count) override
+		{
+			if (_channels != 4)
+			{
+				_converted.resize(static_cast<size_t>(count) * _size.x * _channels);
+				selectChannels(_format, rows, static_cast<size_t>(count) * _size.x, _converted.data());
+				rows = _converted.data();
+			}
+			return _writeFiltered(rows, count);
+		}
+		// rows of palette indices, for the indexed constructor
+		bool writeIndices(const sf::Uint8* rows, const unsigned int count)
+		{
+			return _writeFiltered(rows, count);
+		}
+		bool finish() override
+		{
+			_compress(true);
+			_chunk("IEND", std::vector<sf::Uint8>());
+			_out.close();
+			return !_out.fail();
+		}
+	};
+
+	// uncompressed 8, 24 or 32 bit TGA with the origin at the top left, rows go straight out
+	class TgaWriter : public ImageWriter
+	{
+		std::ofstream _out;
+		sf::Vector2u _size;
+		size_t _channels;
+		TextureFormat _format;
+		std::vector<sf::Uint8> _row;
+
+	public:
+		TgaWriter(const std::string& path, const sf::Vector2u& size, const TextureFormat format = TextureFormat::RGBA8) :
+			_out(path, std::ios::binary),
+			_size(size),
+			_channels(pixelChannels(format)),
+			_format(format),
+			_row(static_cast<size_t>(size.x) * _channels)
+		{
+			sf::Uint8 header[18] = { 0 };
+			header[2] = _channels == 1 ? 3 : 2;
+			header[12] = static_cast<sf::Uint8>(size.x);
+			header[13] = static_cast<sf::Uint8>(size.x >> 8);
+			header[14] = static_cast<sf::Uint8>(size.y);
+			header[15] = static_cast<sf::Uint8>(size.y >> 8);
+			header[16] = static_cast<sf::Uint8>(_channels * 8);
+			header[17] = static_cast<sf::Uint8>(_channels == 4 ? 0x28 : 0x20);
+			_out.write(reinterpret_cast<const char*>(header), 18);
+		}
+
+		bool writeRows(const sf::Uint8* rows, const unsigned int count) override
+		{
+			for (unsigned int y = 0; y < count; ++y)
+			{
+				const sf::Uint8* row = rows + static_cast<size_t>(y) * _size.x * 4;
+				selectChannels(_format, row, _size.x, _row.data());
+				if (_channels > 1)
+					for (size_t i = 0; i < _row.size(); i += _channels)
+						std::swap(_row[i], _row[i + 2]);
+				_out.write(reinterpret_cast<const char*>(_row.data()), _row.size());
+			}
+			return static_cast<bool>(_out);
+		}
+		bool finish() override
+		{
+			_out.close();
+			return !_out.fail();
+		}
+	};
+
+	// formats without an incremental writer are collected and saved through sf::Image
+	class BufferedWriter : public ImageWriter
+	{
+		std::string _path;
+		Bitmap _image;
+		unsigned int _written = 0;
+
+	public:
+		BufferedWriter(const std::string& path, const sf::Vector2u& size) :
+			_path(path),
+			_image(size)
+		{}
+
+		bool writeRows(const sf::Uint8* rows, const unsigned int count) override
+		{
+			std::memcpy(_image.row(_written), rows, static_cast<size_t>(count) * _image.stride());
+			_written += count;
+			return true;
+		}
+		bool finish() override
+		{
+			return _image.toImage().saveToFile(_path);
+		}
+	};
+
+	// dominant direction of the points around their mean, from a few rounds of power iteration on the covariance
+	void _principalAxis(const float (*points)[4], const size_t count, const size_t channels, float mean[4], float axis[4])
+	{
+		float low[4] = { 255, 255, 255, 255 }, high[4] = { 0, 0, 0, 0 };
+		for (size_t c = 0; c < 4; ++c)
+			mean[c] = axis[c] = 0;
+		for (size_t i = 0; i < count; ++i)
+			for (size_t c = 0; c < channels; ++c)
+			{
+				mean[c] += points[i][c] / count;
+				low[c] = std::min(low[c], points[i][c]);
+				high[c] = std::max(high[c], points[i][c]);
+			}
+
+		float covariance[4][4] = { 0 };
+		for (size_t i = 0; i < count; ++i)
+			for (size_t a = 0; a < channels; ++a)
+				for (size_t b = 0; b < channels; ++b)
+					covariance[a][b] += (points[i][a] - mean[a]) * (points[i][b] - mean[b]);
+
+		for (size_t c = 0; c < channels; ++c)
+			axis[c] = high[c] - low[c];
+		for (int iteration = 0; iteration < 8; ++iteration)
+		{
+			float next[4] = { 0 }, length = 0;
+			for (size_t a = 0; a < channels; ++a)
+			{
+				for (size_t b = 0; b < channels; ++b)
+					next[a] += covariance[a][b] * axis[b];
+				length = std::max(length, std::abs(next[a]));
+			}
+			if (length == 0)
+				break;
+			for (size_t c = 0; c < channels; ++c)
+				axis[c] = next[c] / length;
+		}
+	}
+
+	inline sf::Uint16 _to565(const float* color)
+	{
+		const int r = std::min(31, std::max(0, static_cast<int>(color[0] * 31 / 255 + 0.5f)));
+		const int g = std::min(63, std::max(0, static_cast<int>(color[1] * 63 / 255 + 0.5f)));
+		const int b = std::min(31, std::max(0, static_cast<int>(color[2] * 31 / 255 + 0.5f)));
+		return static_cast<sf::Uint16>(r << 11 | g << 5 | b);
+	}
+	inline void _from565(const sf::Uint16 color, int* out)
+	{
+		const int r = color >> 11, g = color >> 5 & 63, b = color & 31;
+		out[0] = r << 3 | r >> 2;
+		out[1] = g << 2 | g >> 4;
+		out[2] = b << 3 | b >> 2;
+	}
+
+	// BC1 colour block, pixels with alpha below 128 become transparent when punchThrough is set
+	// (BC3 passes false, its colour block is always read in four colour mode)
+	void _encodeColorBlock(const sf::Uint8* pixels, sf::Uint8* out, const bool punchThrough)
+	{
+		float points[16][4];
+		bool transparent[16];
+		size_t count = 0;
+		for (size_t i = 0; i < 16; ++i)
+		{
+			transparent[i] = punchThrough && pixels[i * 4 + 3] < 128;
+			if (!transparent[i])
+			{
+				for (size_t c = 0; c < 3; ++c)
+					points[count][c] = pixels[i * 4 + c];
+				++count;
+			}
+		}
+		const bool threeColor = count < 16;
+
+		float mean[4], axis[4];
+		_principalAxis(points, count, 3, mean, axis);
+		float low = 0, high = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			const float t = (points[i][0] - mean[0]) * axis[0] + (points[i][1] - mean[1]) * axis[1] + (points[i][2] - mean[2]) * axis[2];
+			low = std::min(low, t);
+			high = std::max(high, t);
+		}
+		float ends[2][4];
+		for (size_t c = 0; c < 3; ++c)
+		{
+			ends[0][c] = mean[c] + axis[c] * high;
+			ends[1][c] = mean[c] + axis[c] * low;
+		}
+
+		sf::Uint16 c0 = _to565(ends[0]), c1 = _to565(ends[1]);
+		// the order of the endpoints selects the mode
+		if (threeColor ? c0 > c1 : c0 < c1)
+			std::swap(c0, c1);
+
+		int palette[4][3];
+		_from565(c0, palette[0]);
+		_from565(c1, palette[1]);
+		const size_t colors = threeColor || c0 == c1 ? 3 : 4;
+		for (size_t c = 0; c < 3; ++c)
+			if (colors == 3)
+			{
+				palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+				palette[3][c] = 0;
+			}
+			else
+			{
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+
+		sf::Uint32 indices = 0;
+		for (size_t i = 0; i < 16; ++i)
+		{
+			size_t best = 3;
+			if (!transparent[i])
+			{
+				int bestError = std::numeric_limits<int>::max();
+				for (size_t p = 0; p < colors; ++p)
+				{
+					int error = 0;
+					for (size_t c = 0; c < 3; ++c)
+						error += (pixels[i * 4 + c] - palette[p][c]) * (pixels[i * 4 + c] - palette[p][c]);
+					if (error < bestError)
+					{
+						bestError = error;
+						best = p;
+					}
+				}
+			}
+			indices |= static_cast<sf::Uint32>(best) << (i * 2);
+		}
+
+		out[0] = static_cast<sf::Uint8>(c0);
+		out[1] = static_cast<sf::Uint8>(c0 >> 8);
+		out[2] = static_cast<sf::Uint8>(c1);
+		out[3] = static_cast<sf::Uint8>(c1 >> 8);
+		for (size_t b = 0; b < 4; ++b)
+			out[4 + b] = static_cast<sf::Uint8>(indices >> (b * 8));
+	}
+
+	// BC3 alpha block, the eight value mode spanning the block's alpha range
+	void _encodeAlphaBlock(const sf::Uint8* pixels, sf::Uint8* out)
+	{
+		int a0 = 0, a1 = 255;
+		for (size_t i = 0; i < 16; ++i)
+		{
+			a0 = std::max(a0, static_cast<int>(pixels[i * 4 + 3]));
+			a1 = std::min(a1, static_cast<int>(pixels[i * 4 + 3]));
+		}
+
+		int values[8] = { a0, a1 };
+		for (int k = 1; k < 7; ++k)
+			values[k + 1] = ((7 - k) * a0 + k * a1) / 7;
+
+		sf::Uint64 indices = 0;
+		if (a0 != a1)
+			for (size_t i = 0; i < 16; ++i)
+			{
+				size_t best = 0;
+				for (size_t k = 1; k < 8; ++k)
+					if (std::abs(pixels[i * 4 + 3] - values[k]) < std::abs(pixels[i * 4 + 3] - values[best]))
+						best = k;
+				indices |= static_cast<sf::Uint64>(best) << (i * 3);
+			}
+
+		out[0] = static_cast<sf::Uint8>(a0);
+		out[1] = static_cast<sf::Uint8>(a1);
+		for (size_t b = 0; b < 6; ++b)
+			out[2 + b] = static_cast<sf::Uint8>(indices >> (b * 8));
+	}
+
+	// BC7 mode 6: one subset, 7.7.7.7 endpoints with a shared bit each and 4 bit indices
+	class _Bc7Mode6
+	{
+		static const int Weights[16];
+
+		// the 8 bit endpoint closest to the value, among those with the given low bit
+		static inline int _quantize(const float value, const int bit)
+		{
+			const int q = std::min(127, std::max(0, static_cast<int>((value - bit) / 2 + 0.5f)));
+			return q << 1 | bit;
+		}
+		static void _quantize(const float ends[2][4], int quantized[2][4])
+		{
+			for (size_t e = 0; e < 2; ++e)
+			{
+				float bestError = std::numeric_limits<float>::max();
+				for (int bit = 0; bit < 2; ++bit)
+				{
+					float error = 0;
+					int candidate[4];
+					for (size_t c = 0; c < 4; ++c)
+					{
+						candidate[c] = _quantize(ends[e][c], bit);
+						error += (candidate[c] - ends[e][c]) * (candidate[c] - ends[e][c]);
+					}
+					if (error < bestError)
+					{
+						bestError = error;
+						std::copy(candidate, candidate + 4, quantized[e]);
+					}
+				}
+			}
+		}
+		static sf::Uint64 _selectIndices(const sf::Uint8* pixels, const int ends[2][4], int indices[16])
+		{
+			int palette[16][4];
+			for (size_t k = 0; k < 16; ++k)
+				for (size_t c = 0; c < 4; ++c)
+					palette[k][c] = ((64 - Weights[k]) * ends[0][c] + Weights[k] * ends[1][c] + 32) >> 6;
+
+			sf::Uint64 total = 0;
+			for (size_t i = 0; i < 16; ++i)
+			{
+				int bestError = std::numeric_limits<int>::max();
+				for (size_t k = 0; k < 16; ++k)
+				{
+					int error = 0;
+					for (size_t c = 0; c < 4; ++c)
+						error += (pixels[i * 4 + c] - palette[k][c]) * (pixels[i * 4 + c] - palette[k][c]);
+					if (error < bestError)
+					{
+						bestError = error;
+						indices[i] = static_cast<int>(k);
+					}
+				}
+				total += bestError;
+			}
+			return total;
+		}
+
+	public:
+		static void encode(const sf::Uint8* pixels, sf::Uint8* out)
+		{
+			float points[16][4];
+			for (size_t i = 0; i < 16; ++i)
+				for (size_t c = 0; c < 4; ++c)
+					points[i][c] = pixels[i * 4 + c];
+
+			float mean[4], axis[4];
+			_principalAxis(points, 16, 4, mean, axis);
+			float low = 0, high = 0;
+			for (size_t i = 0; i < 16; ++i)
+			{
+				float t = 0;
+				for (size_t c = 0; c < 4; ++c)
+					t += (points[i][c] - mean[c]) * axis[c];
+				low = std::min(low, t);
+				high = std::max(high, t);
+			}
+			float ends[2][4];
+			for (size_t c = 0; c < 4; ++c)
+			{
+				ends[0][c] = mean[c] + axis[c] * low;
+				ends[1][c] = mean[c] + axis[c] * high;
+			}
+
+			int quantized[2][4], indices[16];
+			_quantize(ends, quantized);
+			sf::Uint64 error = _selectIndices(pixels, quantized, indices);
+
+			// one least squares pass fitting the endpoints to the chosen weights
+			float aa = 0, ab = 0, bb = 0, ax[4] = { 0 }, bx[4] = { 0 };
+			for (size_t i = 0; i < 16; ++i)
+			{
+				const float b = Weights[indices[i]] / 64.0f, a = 1 - b;
+				aa += a * a;
+				ab += a * b;
+				bb += b * b;
+				for (size_t c = 0; c < 4; ++c)
+				{
+					ax[c] += a * points[i][c];
+					bx[c] += b * points[i][c];
+				}
+			}
+			const float determinant = aa * bb - ab * ab;
+			if (std::abs(determinant) > 1e-6f)
+			{
+				float fitted[2][4];
+				for (size_t c = 0; c < 4; ++c)
+				{
+					fitted[0][c] = std::min(255.0f, std::max(0.0f, (ax[c] * bb - bx[c] * ab) / determinant));
+					fitted[1][c] = std::min(255.0f, std::max(0.0f, (bx[c] * aa - ax[c] * ab) / determinant));
+				}
+				int refined[2][4], refinedIndices[16];
+				_quantize(fitted, refined);
+				if (_selectIndices(pixels, refined, refinedIndices) < error)
+				{
+					std::copy(&refined[0][0], &refined[0][0] + 8, &quantized[0][0]);
+					std::copy(refinedIndices, refinedIndices + 16, indices);
+				}
+			}
+
+			// the first index is stored with its top bit implied zero
+			if (indices[0] & 8)
+			{
+				for (size_t c = 0; c < 4; ++c)
+					std::swap(quantized[0][c], quantized[1][c]);
+				for (size_t i = 0; i < 16; ++i)
+					indices[i] = 15 - indices[i];
+			}
+
+			sf::Uint64 bits[2] = { 0, 0 };
+			size_t position = 0;
+			const auto put = [&](const sf::Uint64 value, const size_t length)
+			{
+				for (size_t b = 0; b < length; ++b, ++position)
+					bits[position / 64] |= (value >> b & 1) << (position % 64);
+			};
+			put(1 << 6, 7);
+			for (size_t c = 0; c < 4; ++c)
+			{
+				put(quantized[0][c] >> 1, 7);
+				put(quantized[1][c] >> 1, 7);
+			}
+			put(quantized[0][0] & 1, 1);
+			put(quantized[1][0] & 1, 1);
+			put(indices[0], 3);
+			for (size_t i = 1; i < 16; ++i)
+				put(indices[i], 4);
+
+			for (size_t b = 0; b < 16; ++b)
+				out[b] = static_cast<sf::Uint8>(bits[b / 8] >> (b % 8 * 8));
+		}
+	};
+	const int _Bc7Mode6::Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	// pixels is a 4x4 RGBA block, row after row
+	void encodeBlock(const TextureFormat format, const sf::Uint8* pixels, sf::Uint8* out)
+	{
+		switch (format)
+		{
+		case TextureFormat::BC1:
+			_encodeColorBlock(pixels, out, true);
+			break;
+		case TextureFormat::BC3:
+			_encodeAlphaBlock(pixels, out);
+			_encodeColorBlock(pixels, out + 8, false);
+			break;
+		case TextureFormat::BC7:
+			_Bc7Mode6::encode(pixels, out);
+			break;
+		default:
+			std::memcpy(out, pixels, 64);
+		}
+	}
+
+	enum class TextureContainer
+	{
+		DDS,
+		KTX2
+	};
+
+	// bytes of one level of the given size
+	inline sf::Uint64 textureBytes(const TextureFormat format, const sf::Vector2u& size)
+	{
+		if (!isBlockCompressed(format))
+			return static_cast<sf::Uint64>(size.x) * size.y * blockBytes(format);
+		return static_cast<sf::Uint64>((size.x + 3) / 4) * ((size.y + 3) / 4) * blockBytes(format);
+	}
+
+	// bytes of a texture and its mip levels, what it takes in video memory once uploaded
+	inline sf::Uint64 chainBytes(const TextureFormat format, const sf::Vector2u& size, const unsigned int levels)
+	{
+		sf::Uint64 bytes = 0;
+		for (unsigned int l = 0; l < std::max(1u, levels); ++l)
+			bytes += textureBytes(format, sf::Vector2u(std::max(1u, size.x >> l), std::max(1u, size.y >> l)));
+		return bytes;
+	}
+
+	inline void _putLE(std::ostream& out, const sf::Uint64 value, const size_t bytes)
+	{
+		for (size_t b = 0; b < bytes; ++b)
+			out.put(static_cast<char>(value >> (b * 8)));
+	}
+
+	void writeDdsHeader(std::ostream& out, const TextureFormat format, const sf::Vector2u& size, const size_t levels = 1, const bool linear = false, const bool premultiplied = false)
+	{
+		const bool compressed = isBlockCompressed(format), extended = format == TextureFormat::BC7;
+		out.write("DDS ", 4);
+		_putLE(out, 124, 4);
+		// caps, height, width, pixel format, plus pitch or linear size and the mip count
+		_putLE(out, 0x1007 | (compressed ? 0x80000 : 0x8) | (levels > 1 ? 0x20000 : 0), 4);
+		_putLE(out, size.y, 4);
+		_putLE(out, size.x, 4);
+		_putLE(out, compressed ? textureBytes(format, size) : static_cast<sf::Uint64>(size.x) * blockBytes(format), 4);
+		_putLE(out, 0, 4);
+		_putLE(out, levels, 4);
+		for (size_t i = 0; i < 11; ++i)
+			_putLE(out, 0, 4);
+
+		_putLE(out, 32, 4);
+		if (compressed)
+		{
+			_putLE(out, 0x4, 4);
+			out.write(format == TextureFormat::BC1 ? "DXT1" : format == TextureFormat::BC3 ? "DXT5" : "DX10", 4);
+			for (size_t i = 0; i < 5; ++i)
+				_putLE(out, 0, 4);
+		}
+		else
+		{
+			// rgb / alpha / luminance flags and the channel masks of the packed texel
+			static const sf::Uint32 masks[][5] = {
+				{ 0x41, 0x000000FF, 0x0000FF00, 0x00FF0000, 0xFF000000 }, {}, {}, {},
+				{ 0x40, 0x000000FF, 0x0000FF00, 0x00FF0000, 0 },
+				{ 0x40, 0xF800, 0x07E0, 0x001F, 0 },
+				{ 0x41, 0xF000, 0x0F00, 0x00F0, 0x000F },
+				{ 0x41, 0xF800, 0x07C0, 0x003E, 0x0001 },
+				{ 0x2, 0, 0, 0, 0xFF },
+				{ 0x20000, 0xFF, 0, 0, 0 } };
+			const sf::Uint32* mask = masks[static_cast<size_t>(format)];
+			_putLE(out, mask[0], 4);
+			_putLE(out, 0, 4);
+			_putLE(out, blockBytes(format) * 8, 4);
+			for (size_t c = 1; c < 5; ++c)
+				_putLE(out, mask[c], 4);
+		}
+
+		// texture, complex and mipmap caps when there's a chain
+		_putLE(out, 0x1000 | (levels > 1 ? 0x400008 : 0), 4);
+		for (size_t i = 0; i < 4; ++i)
+			_putLE(out, 0, 4);
+
+		// BC7 only has a DXGI format, sRGB unless the colour was converted to linear, and the alpha mode
+		if (extended)
+		{
+			_putLE(out, linear ? 98 : 99, 4);
+			_putLE(out, 3, 4);
+			_putLE(out, 0, 4);
+			_putLE(out, 1, 4);
+			_putLE(out, premultiplied ? 2 : 0, 4);
+		}
+	}
+
+	// levels are given largest first and laid out smallest first as the format asks, returns the offset of each
+	std::vector<sf::Uint64> writeKtx2Header(std::ostream& out, const TextureFormat format, const sf::Vector2u& size, const std::vector<sf::Uint64>& levelBytes, const size_t layers = 0,
+		const bool linear = false, const bool premultiplied = false)
+	{
+		static const sf::Uint8 identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+		out.write(reinterpret_cast<const char*>(identifier), 12);
+
+		// sRGB Vulkan formats where there is one, the packed 16 bit and alpha formats only come as UNORM, as does linear colour
+		static const sf::Uint32 vkFormats[] = { 43, 134, 138, 146, 29, 4, 2, 6, 1000470001, 15 };
+		static const sf::Uint32 unormFormats[] = { 37, 133, 137, 145, 23, 4, 2, 6, 1000470001, 9 };
+		const sf::Uint32 vkFormat = (linear ? unormFormats : vkFormats)[static_cast<size_t>(format)];
+		const bool packed16 = format == TextureFormat::RGB565 || format == TextureFormat::RGBA4444 || format == TextureFormat::RGBA5551;
+		const bool srgb = !linear && !packed16 && format != TextureFormat::A8;
+		_putLE(out, vkFormat, 4);
+		// type size, the packed 16 bit formats are read as whole 16 bit words
+		_putLE(out, packed16 ? 2 : 1, 4);
+		_putLE(out, size.x, 4);
+		_putLE(out, size.y, 4);
+		_putLE(out, 0, 4);
+		_putLE(out, layers, 4);
+		_putLE(out, 1, 4);
+		_putLE(out, levelBytes.size(), 4);
+		_putLE(out, 0, 4);
+
+		// data format descriptor, one basic block
+		struct Sample { sf::Uint32 offset, length, channel, upper; };
+		std::vector<Sample> samples;
+		sf::Uint32 model = 1, blockSize = 0;
+		switch (format)
+		{
+		case TextureFormat::BC1:
+			model = 128;
+			samples = { { 0, 64, 0, 0xFFFFFFFF }, { 0, 64, 1 | 0x10, 0xFFFFFFFF } };
+			break;
+		case TextureFormat::BC3:
+			model = 130;
+			samples = { { 0, 64, 15 | 0x10, 0xFFFFFFFF }, { 64, 64, 0, 0xFFFFFFFF } };
+			break;
+		case TextureFormat::BC7:
+			model = 134;
+			samples = { { 0, 128, 0, 0xFFFFFFFF } };
+			break;
+		case TextureFormat::RGB8:
+			samples = { { 0, 8, 0, 255 }, { 8, 8, 1, 255 }, { 16, 8, 2, 255 } };
+			break;
+		case TextureFormat::RGB565:
+			samples = { { 0, 5, 2, 31 }, { 5, 6, 1, 63 }, { 11, 5, 0, 31 } };
+			break;
+		case TextureFormat::RGBA4444:
+			samples = { { 0, 4, 15, 15 }, { 4, 4, 2, 15 }, { 8, 4, 1, 15 }, { 12, 4, 0, 15 } };
+			break;
+		case TextureFormat::RGBA5551:
+			samples = { { 0, 1, 15, 1 }, { 1, 5, 2, 31 }, { 6, 5, 1, 31 }, { 11, 5, 0, 31 } };
+			break;
+		case TextureFormat::A8:
+			samples = { { 0, 8, 15, 255 } };
+			break;
+		case TextureFormat::L8:
+			samples = { { 0, 8, 0, 255 } };
+			break;
+		default:
+			samples = { { 0, 8, 0, 255 }, { 8, 8, 1, 255 }, { 16, 8, 2, 255 }, { 24, 8, 15 | 0x10, 255 } };
+		}
+		if (isBlockCompressed(format))
+			blockSize = 0x0303;
+
+		const sf::Uint32 dfdLength = static_cast<sf::Uint32>(4 + 24 + 16 * samples.size());
+		const sf::Uint32 dfdOffset = static_cast<sf::Uint32>(80 + 24 * levelBytes.size());
+		_putLE(out, dfdOffset, 4);
+		_putLE(out, dfdLength, 4);
+		_putLE(out, 0, 4);
+		_putLE(out, 0, 4);
+		_putLE(out, 0, 8);
+		_putLE(out, 0, 8);
+
+		// smallest level right after the descriptor, every level starts on a 16 byte boundary
+		std::vector<sf::Uint64> offsets(levelBytes.size());
+		sf::Uint64 offset = dfdOffset + dfdLength;
+		for (size_t l = levelBytes.size(); l-- > 0;)
+		{
+			offset = (offset + 15) / 16 * 16;
+			offsets[l] = offset;
+			offset += levelBytes[l];
+		}
+		for (size_t l = 0; l < levelBytes.size(); ++l)
+		{
+			_putLE(out, offsets[l], 8);
+			_putLE(out, levelBytes[l], 8);
+			_putLE(out, levelBytes[l], 8);
+		}
+
+		_putLE(out, dfdLength, 4);
+		_putLE(out, 0, 4);
+		_putLE(out, 2 | (24 + 16 * samples.size()) << 16, 4);
+		// colour model, BT.709 primaries, sRGB or linear transfer, straight or premultiplied alpha
+		_putLE(out, model | 1 << 8 | (srgb ? 2 : 1) << 16 | (premultiplied ? 1 : 0) << 24, 4);
+		_putLE(out, blockSize, 4);
+		_putLE(out, blockBytes(format), 4);
+		_putLE(out, 0, 4);
+		for (size_t s = 0; s < samples.size(); ++s)
+		{
+			_putLE(out, samples[s].offset | (samples[s].length - 1) << 16 | samples[s].channel << 24, 4);
+			_putLE(out, 0, 4);
+			_putLE(out, 0, 4);
+			_putLE(out, samples[s].upper, 4);
+		}
+		return offsets;
+	}
+
+	// blocks of the image in row order, or the pixels themselves when uncompressed
+	std::vector<sf::Uint8> encodeTexture(const TextureFormat format, const sf::Uint8* pixels, const unsigned int width, const unsigned int height, const size_t threads = 0)
+	{
+		if (!isBlockCompressed(format))
+		{
+			std::vector<sf::Uint8> packed(static_cast<size_t>(width) * height * blockBytes(format));
+			packPixels(format, pixels, static_cast<size_t>(width) * height, packed.data());
+			return packed;
+		}
+
+		const size_t stride = static_cast<size_t>(width) * 4, columns = (width + 3) / 4, bytes = blockBytes(format);
+		std::vector<sf::Uint8> encoded(columns * ((height + 3) / 4) * bytes);
+		util::parallelFor(columns * ((height + 3) / 4), [&](const size_t b)
+		{
+			// blocks past the right or bottom edge repeat the last column or row
+			sf::Uint8 block[64];
+			const size_t top = b / columns * 4, left = b % columns * 4;
+			for (size_t y = 0; y < 4; ++y)
+				for (size_t x = 0; x < 4; ++x)
+					std::memcpy(block + (y * 4 + x) * 4, pixels + std::min<size_t>(top + y, height - 1) * stride + std::min<size_t>(left + x, width - 1) * 4, 4);
+			encodeBlock(format, block, encoded.data() + b * bytes);
+		}, threads);
+		return encoded;
+	}
+
+	// a single level DDS or KTX2 texture, every complete row of 4x4 blocks is encoded as soon as its pixels arrive
+	class TextureWriter : public ImageWriter
+	{
+		std::ofstream _out;
+		sf::Vector2u _size;
+		TextureFormat _format;
+		size_t _threads;
+		std::vector<sf::Uint8> _rows;
+
+		void _encode(const unsigned int rows)
+		{
+			const std::vector<sf::Uint8> encoded = encodeTexture(_format, _rows.data(), _size.x, rows, _threads);
+			_out.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+			_rows.erase(_rows.begin(), _rows.begin() + rows * static_cast<size_t>(_size.x) * 4);
+		}
+
+	public:
+		TextureWriter(const std::string& path, const sf::Vector2u& size, const TextureFormat format, const TextureContainer container, const size_t threads = 0,
+			const ColorConverter& color = ColorConverter()) :
+			_out(path, std::ios::binary),
+			_size(size),
+			_format(format),
+			_threads(threads)
+		{
+			if (container == TextureContainer::DDS)
+				writeDdsHeader(_out, format, size, 1, color.isLinear(), color.isPremultiplied());
+			else
+			{
+				const std::vector<sf::Uint64> offsets = writeKtx2Header(_out, format, size, std::vector<sf::Uint64>(1, textureBytes(format, size)), 0,
+					color.isLinear(), color.isPremultiplied());
+				while (static_cast<sf::Uint64>(_out.tellp()) < offsets[0])
+					_out.put(0);
+			}
+		}
+
+		bool writeRows(const sf::Uint8* rows, const unsigned int count) override
+		{
+			const size_t stride = static_cast<size_t>(_size.x) * 4;
+			if (!isBlockCompressed(_format))
+			{
+				const std::vector<sf::Uint8> packed = encodeTexture(_format, rows, _size.x, count);
+				_out.write(reinterpret_cast<const char*>(packed.data()), packed.size());
+			}
+			else if (_size.x)
+			{
+				_rows.insert(_rows.end(), rows, rows + count * stride);
+				if (_rows.size() >= 4 * stride)
+					_encode(static_cast<unsigned int>(_rows.size() / (4 * stride)) * 4);
+			}
+			return static_cast<bool>(_out);
+		}
+		bool finish() override
+		{
+			if (isBlockCompressed(_format) && !_rows.empty())
+				_encode(static_cast<unsigned int>(_rows.size() / (static_cast<size_t>(_size.x) * 4)));
+			_out.close();
+			return !_out.fail();
+		}
+	};
+
+	// the chain below level 0, every cell (a sprite's rect grown to the packer's alignment) is scaled down from its own
+	// pixels, so texels never mix across sprite boundaries at any level, colour cells are filtered in linear light
+	// and the rest (channel packed masks, whose alpha is a layer of its own) channel by channel as plain values,
+	// cells must not overlap, which is why mask packing only exports a single level
+	std::vector<Bitmap> buildMipChain(Bitmap&& base, const std::vector<sf::IntRect>& cells, const std::vector<sf::IntRect>& colorCells, size_t levelCount,
+		const Filter filter)
+	{
+		std::set<std::tuple<int, int, int, int>> color;
+		for (size_t c = 0; c < colorCells.size(); ++c)
+			color.insert(std::make_tuple(colorCells[c].left, colorCells[c].top, colorCells[c].width, colorCells[c].height));
+
+		size_t fullChain = 1;
+		while ((std::max(base.size.x, base.size.y) >> fullChain) > 0)
+			++fullChain;
+		levelCount = std::max<size_t>(1, std::min(levelCount, fullChain));
+
+		std::vector<Bitmap> levels;
+		levels.reserve(levelCount);
+		levels.push_back(std::move(base));
+		const Bitmap& top = levels[0];
+		for (size_t l = 1; l < levelCount; ++l)
+		{
+			Bitmap level(sf::Vector2u(std::max(1u, top.size.x >> l), std::max(1u, top.size.y >> l)));
+			const int scale = 1 << l;
+			for (size_t c = 0; c < cells.size(); ++c)
+			{
+				sf::IntRect source;
+				if (!cells[c].intersects(sf::IntRect(0, 0, top.size.x, top.size.y), source))
+					continue;
+
+				const int left = source.left / scale, upper = source.top / scale;
+				const int right = std::min(static_cast<int>(level.size.x), (source.left + source.width + scale - 1) / scale);
+				const int bottom = std::min(static_cast<int>(level.size.y), (source.top + source.height + scale - 1) / scale);
+				if (right <= left || bottom <= upper)
+					continue;
+
+				const bool channels = !color.count(std::make_tuple(cells[c].left, cells[c].top, cells[c].width, cells[c].height));
+				resample(top.row(source.top) + source.left * 4, source.width, source.height, top.stride(),
+					level.row(upper) + left * 4, right - left, bottom - upper, level.stride(), filter, true, channels);
+			}
+			levels.push_back(std::move(level));
+		}
+		return levels;
+	}
+
+	// the whole texture with its chain, level 0 first
+	bool saveTexture(const std::string& path, const TextureContainer container, const TextureFormat format, const std::vector<Bitmap>& levels, const size_t threads = 0,
+		const ColorConverter& color = ColorConverter())
+	{
+		std::ofstream out(path, std::ios::binary);
+		std::vector<std::vector<sf::Uint8>> encoded(levels.size());
+		std::vector<sf::Uint64> bytes(levels.size());
+		for (size_t l = 0; l < levels.size(); ++l)
+		{
+			encoded[l] = encodeTexture(format, levels[l].pixels.data(), levels[l].size.x, levels[l].size.y, threads);
+			bytes[l] = encoded[l].size();
+		}
+
+		if (container == TextureContainer::DDS)
+		{
+			writeDdsHeader(out, format, levels[0].size, levels.size(), color.isLinear(), color.isPremultiplied());
+			for (size_t l = 0; l < levels.size(); ++l)
+				out.write(reinterpret_cast<const char*>(encoded[l].data()), encoded[l].size());
+		}
+		else
+		{
+			const std::vector<sf::Uint64> offsets = writeKtx2Header(out, format, levels[0].size, bytes, 0, color.isLinear(), color.isPremultiplied());
+			for (size_t l = levels.size(); l-- > 0;)
+			{
+				while (static_cast<sf::Uint64>(out.tellp()) < offsets[l])
+					out.put(0);
+				out.write(reinterpret_cast<const char*>(encoded[l].data()), encoded[l].size());
+			}
+		}
+		out.close();
+		return !out.fail();
+	}
+
+	// every level of a chain holds straight sRGB (colour cells are only filtered in linear light), so the colour cells
+	// of every level are converted afterwards, each texel once even where mask packed cells overlap on level 0
+	void convertChain(std::vector<Bitmap>& levels, const std::vector<sf::IntRect>& colorCells, const ColorConverter& color, const size_t threads = 0)
+	{
+		for (size_t l = 0; l < levels.size(); ++l)
+		{
+			Bitmap& level = levels[l];
+			const int scale = 1 << l;
+			std::vector<bool> covered(static_cast<size_t>(level.size.x) * level.size.y, false);
+			for (size_t c = 0; c < colorCells.size(); ++c)
+			{
+				const sf::IntRect& cell = colorCells[c];
+				const int left = std::max(cell.left, 0) / scale, upper = std::max(cell.top, 0) / scale;
+				const int right = std::min(static_cast<int>(level.size.x), (cell.left + cell.width + scale - 1) / scale);
+				const int bottom = std::min(static_cast<int>(level.size.y), (cell.top + cell.height + scale - 1) / scale);
+				for (int y = upper; y < bottom; ++y)
+					for (int x = left; x < right; ++x)
+						covered[static_cast<size_t>(y) * level.size.x + x] = true;
+			}
+			util::parallelFor(level.size.y, [&](const size_t y)
+			{
+				for (unsigned int x = 0; x < level.size.x;)
+				{
+					unsigned int end = x;
+					while (end < level.size.x && covered[y * level.size.x + end])
+						++end;
+					if (end > x)
+						color.apply(level.row(static_cast<unsigned int>(y)) + x * 4, end - x);
+					x = end + 1;
+				}
+			}, threads);
+		}
+	}
+
+	// collects level 0, the chain is built once the page is complete
+	class MipChainWriter : public ImageWriter
+	{
+		std::string _path;
+		TextureContainer _container;
+		TextureFormat _format;
+		Bitmap _base;
+		unsigned int _written = 0;
+		std::vector<sf::IntRect> _cells, _colorCells;
+		size_t _levels, _threads;
+		Filter _filter;
+		ColorConverter _color;
+
+	public:
+		// colour cells are the cells the converter applies to, single channel layers are data and stay as they are
+		MipChainWriter(const std::string& path, const sf::Vector2u& size, const TextureContainer container, const TextureFormat format,
+			const size_t levels, const std::vector<sf::IntRect>& cells, const Filter filter, const size_t threads = 0,
+			const ColorConverter& color = ColorConverter(), const std::vector<sf::IntRect>& colorCells = std::vector<sf::IntRect>()) :
+			_path(path),
+			_container(container),
+			_format(format),
+			_base(size),
+			_cells(cells),
+			_colorCells(colorCells),
+			_levels(levels),
+			_threads(threads),
+			_filter(filter),
+			_color(color)
+		{}
+
+		bool writeRows(const sf::Uint8* rows, const unsigned int count) override
+		{
+			std::memcpy(_base.row(_written), rows, static_cast<size_t>(count) * _base.stride());
+			_written += count;
+			return true;
+		}
+		bool finish() override
+		{
+			std::vector<Bitmap> chain = buildMipChain(std::move(_base), _cells, _colorCells, _levels, _filter);
+			if (!_color.isIdentity())
+				convertChain(chain, _colorCells, _color, _threads);
+			return saveTexture(_path, _container, _format, chain, _threads, _color);
+		}
+	};
+
+	// equal size pages as the layers of one KTX2 array texture, every level holds all the layers one after another
+	// so the layers are encoded as they're finished and the file is written once the last one is in
+	class TextureArrayWriter
+	{
+		std::string _path;
+		sf::Vector2u _size;
+		TextureFormat _format;
+		size_t _levels, _layers = 0, _threads;
+		Filter _filter;
+		ColorConverter _color;
+		std::vector<std::vector<sf::Uint8>> _encoded;
+
+		class Layer : public ImageWriter
+		{
+			TextureArrayWriter& _array;
+			Bitmap _base;
+			unsigned int _written = 0;
+			std::vector<sf::IntRect> _cells, _colorCells;
+
+		public:
+			Layer(TextureArrayWriter& array, const std::vector<sf::IntRect>& cells, const std::vector<sf::IntRect>& colorCells) :
+				_array(array),
+				_base(array._size),
+				_cells(cells),
+				_colorCells(colorCells)
+			{}
+
+			bool writeRows(const sf::Uint8* rows, const unsigned int count) override
+			{
+				std::memcpy(_base.row(_written), rows, static_cast<size_t>(count) * _base.stride());
+				_written += count;
+				return true;
+			}
+			bool finish() override
+			{
+				std::vector<Bitmap> chain;
+				if (_array._levels > 1)
+				{
+					chain = buildMipChain(std::move(_base), _cells, _colorCells, _array._levels, _array._filter);
+					if (!_array._color.isIdentity())
+						convertChain(chain, _colorCells, _array._color, _array._threads);
+				}
+				else
+					chain.push_back(std::move(_base));
+
+				_array._encoded.resize(chain.size());
+				for (size_t l = 0; l < chain.size(); ++l)
+				{
+					const std::vector<sf::Uint8> encoded = encodeTexture(_array._format, chain[l].pixels.data(), chain[l].size.x, chain[l].size.y, _array._threads);
+					_array._encoded[l].insert(_array._encoded[l].end(), encoded.begin(), encoded.end());
+				}
+				++_array._layers;
+				return true;
+			}
+		};
+
+	public:
+		// colour conversion of single level layers is left to the caller, chains are converted once they're built
+		TextureArrayWriter(const std::string& path, const sf::Vector2u& size, const TextureFormat format, const size_t levels, const Filter filter,
+			const size_t threads = 0, const ColorConverter& color = ColorConverter()) :
+			_path(path),
+			_size(size),
+			_format(format),
+			_levels(levels),
+			_threads(threads),
+			_filter(filter),
+			_color(color)
+		{}
+
+		// the writer of the next layer, cells as for MipChainWriter
+		std::unique_ptr<ImageWriter> openLayer(const std::vector<sf::IntRect>& cells = std::vector<sf::IntRect>(), const std::vector<sf::IntRect>& colorCells = std::vector<sf::IntRect>())
+		{
+			return std::unique_ptr<ImageWriter>(new Layer(*this, cells, colorCells));
+		}
+
+		bool finish()
+		{
+			std::ofstream out(_path, std::ios::binary);
+			std::vector<sf::Uint64> bytes(_encoded.size());
+			for (size_t l = 0; l < _encoded.size(); ++l)
+				bytes[l] = _encoded[l].size();
+
+			const std::vector<sf::Uint64> offsets = writeKtx2Header(out, _format, _size, bytes, _layers, _color.isLinear(), _color.isPremultiplied());
+			for (size_t l = _encoded.size(); l-- > 0;)
+			{
+				while (static_cast<sf::Uint64>(out.tellp()) < offsets[l])
+					out.put(0);
+				out.write(reinterpret_cast<const char*>(_encoded[l].data()), _encoded[l].size());
+			}
+			out.close();
+			return !out.fail();
+		}
+	};
+
+	inline bool textureContainerOf(const std::string& path, TextureContainer& container)
+	{
+		std::string extension = path.substr(path.rfind('.') + 1);
+		std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+		if (extension != "dds" && extension != "ktx2")
+			return false;
+		container = extension == "dds" ? TextureContainer::DDS : TextureContainer::KTX2;
+		return true;
+	}
+
+	// RGBA colours of an indexed image, nearest entries are found through a k-d tree
+	class Palette
+	{
+		struct Node
+		{
+			int entry, axis, left, right;
+		};
+
+		std::vector<sf::Uint8> _entries;
+		std::vector<Node> _nodes;
+		int _root = -1;
+
+		int _build(std::vector<int>& order, const size_t begin, const size_t end, const int depth)
+		{
+			if (begin >= end)
+				return -1;
+
+			const int axis = depth % 4;
+			const size_t middle = (begin + end) / 2;
+			std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end, [&](const int a, const int b)
+			{
+				return _entries[a * 4 + axis] < _entries[b * 4 + axis];
+			});
+
+			const int node = static_cast<int>(_nodes.size());
+			_nodes.push_back({ order[middle], axis, -1, -1 });
+			const int left = _build(order, begin, middle, depth + 1);
+			const int right = _build(order, middle + 1, end, depth + 1);
+			_nodes[node].left = left;
+			_nodes[node].right = right;
+			return node;
+		}
+		void _nearest(const int node, const int* color, int& best, int& bestDistance) const
+		{
+			if (node < 0)
+				return;
+
+			const Node& n = _nodes[node];
+			const sf::Uint8* entry = &_entries[n.entry * 4];
+			int distance = 0;
+			for (size_t c = 0; c < 4; ++c)
+				distance += (color[c] - entry[c]) * (color[c] - entry[c]);
+			if (distance < bestDistance)
+			{
+				bestDistance = distance;
+				best = n.entry;
+			}
+
+			// the far side only matters if the splitting plane is closer than the best match so far
+			const int delta = color[n.axis] - entry[n.axis];
+			_nearest(delta < 0 ? n.left : n.right, color, best, bestDistance);
+			if (delta * delta < bestDistance)
+				_nearest(delta < 0 ? n.right : n.left, color, best, bestDistance);
+		}
+
+	public:
+		// entries are RGBA, the translucent ones are moved to the front so the PNG transparency chunk stays short
+		Palette(const std::vector<sf::Uint8>& entries)
+		{
+			std::vector<int> order(entries.size() / 4);
+			for (size_t i = 0; i < order.size(); ++i)
+				order[i] = static_cast<int>(i);
+			std::stable_sort(order.begin(), order.end(), [&](const int a, const int b) { return entries[a * 4 + 3] < entries[b * 4 + 3]; });
+			for (size_t i = 0; i < order.size(); ++i)
+				_entries.insert(_entries.end(), entries.begin() + order[i] * 4, entries.begin() + order[i] * 4 + 4);
+
+			for (size_t i = 0; i < order.size(); ++i)
+				order[i] = static_cast<int>(i);
+			_root = _build(order, 0, order.size(), 0);
+		}
+
+		inline const std::vector<sf::Uint8>& getEntries() const { return _entries; }
+		inline size_t size() const { return _entries.size() / 4; }
+
+		sf::Uint8 nearest(const int* color) const
+		{
+			int best = 0, bestDistance = std::numeric_limits<int>::max();
+			_nearest(_root, color, best, bestDistance);
+			return static_cast<sf::Uint8>(best);
+		}
+	};
+
+	inline sf::Uint32 _packColor(const sf::Uint8* p)
+	{
+		return static_cast<sf::Uint32>(p[0]) | static_cast<sf::Uint32>(p[1]) << 8 | static_cast<sf::Uint32>(p[2]) << 16 | static_cast<sf::Uint32>(p[3]) << 24;
+	}
+
+	// the image's own colours if there are no more than 256 of them, each band of rows collected on its own thread
+	bool findExactPalette(const Bitmap& image, std::vector<sf::Uint8>& entries)
+	{
+		const size_t bands = std::max(1u, std::thread::hardware_concurrency()) * 4;
+		const unsigned int rowsPerBand = (image.size.y + static_cast<unsigned int>(bands) - 1) / static_cast<unsigned int>(bands);
+		std::vector<std::set<sf::Uint32>> found(bands);
+		std::atomic<bool> tooMany(false);
+		util::parallelFor(bands, [&](const size_t b)
+		{
+			const unsigned int first = static_cast<unsigned int>(b) * rowsPerBand, last = std::min(image.size.y, first + rowsPerBand);
+			for (unsigned int y = first; y < last && !tooMany; ++y)
+				for (unsigned int x = 0; x < image.size.x; ++x)
+				{
+					found[b].insert(_packColor(image.row(y) + x * 4));
+					if (found[b].size() > 256)
+					{
+						tooMany = true;
+						return;
+					}
+				}
+		});
+		if (tooMany)
+			return false;
+
+		std::set<sf::Uint32> colors;
+		for (size_t b = 0; b < bands; ++b)
+			colors.insert(found[b].begin(), found[b].end());
+		if (colors.size() > 256)
+			return false;
+
+		entries.clear();
+		for (auto it = colors.begin(); it != colors.end(); ++it)
+			for (size_t c = 0; c < 4; ++c)
+				entries.push_back(static_cast<sf::Uint8>(*it >> (c * 8)));
+		return true;
+	}
+
+	// median cut over a 5 bit per channel histogram: the box with the most weighted spread is split at its median
+	// along its widest channel until there are enough boxes, each box's mean becomes an entry
+	std::vector<sf::Uint8> medianCutPalette(const Bitmap& image, const size_t count)
+	{
+		const size_t bins = 1 << 20;
+		std::unique_ptr<std::atomic<sf::Uint32>[]> histogram(new std::atomic<sf::Uint32>[bins]);
+		for (size_t i = 0; i < bins; ++i)
+			histogram[i].store(0, std::memory_order_relaxed);
+		util::parallelFor(image.size.y, [&](const size_t y)
+		{
+			const sf::Uint8* row = image.row(static_cast<unsigned int>(y));
+			for (unsigned int x = 0; x < image.size.x; ++x)
+			{
+				const sf::Uint8* p = row + x * 4;
+				histogram[(p[0] >> 3) << 15 | (p[1] >> 3) << 10 | (p[2] >> 3) << 5 | p[3] >> 3].fetch_add(1, std::memory_order_relaxed);
+			}
+		});
+
+		struct Bin
+		{
+			sf::Uint8 color[4];
+			sf::Uint32 weight;
+		};
+		std::vector<Bin> used;
+		for (size_t i = 0; i < bins; ++i)
+			if (const sf::Uint32 weight = histogram[i].load(std::memory_order_relaxed))
+			{
+				Bin bin;
+				for (size_t c = 0; c < 4; ++c)
+				{
+					// bit replication keeps the ends of each channel, so opaque stays opaque
+					const size_t level = i >> (15 - c * 5) & 31;
+					bin.color[c] = static_cast<sf::Uint8>(level << 3 | level >> 2);
+				}
+				bin.weight = weight;
+				used.push_back(bin);
+			}
+
+		struct Box
+		{
+			size_t begin, end;
+			int axis;
+			double spread;
+		};
+		const auto measure = [&](Box& box)
+		{
+			int low[4] = { 255, 255, 255, 255 }, high[4] = { 0, 0, 0, 0 };
+			sf::Uint64 weight = 0;
+			for (size_t i = box.begin; i < box.end; ++i)
+			{
+				weight += used[i].weight;
+				for (size_t c = 0; c < 4; ++c)
+				{
+					low[c] = std::min(low[c], static_cast<int>(used[i].color[c]));
+					high[c] = std::max(high[c], static_cast<int>(used[i].color[c]));
+				}
+			}
+			box.axis = 0;
+			for (int c = 1; c < 4; ++c)
+				if (high[c] - low[c] > high[box.axis] - low[box.axis])
+					box.axis = c;
+			box.spread = box.end - box.begin > 1 ? static_cast<double>(high[box.axis] - low[box.axis]) * weight : 0;
+		};
+
+		std::vector<Box> boxes(1, Box{ 0, used.size(), 0, 0 });
+		measure(boxes[0]);
+		while (boxes.size() < count)
+		{
+			const auto widest = std::max_element(boxes.begin(), boxes.end(), [](const Box& a, const Box& b) { return a.spread < b.spread; });
+			if (widest->spread <= 0)
+				break;
+
+			Box box = *widest;
+			std::sort(used.begin() + box.begin, used.begin() + box.end, [&](const Bin& a, const Bin& b) { return a.color[box.axis] < b.color[box.axis]; });
+			sf::Uint64 total = 0, running = 0;
+			for (size_t i = box.begin; i < box.end; ++i)
+				total += used[i].weight;
+			size_t split = box.begin + 1;
+			for (size_t i = box.begin; i + 1 < box.end && running + used[i].weight <= total / 2; ++i)
+			{
+				running += used[i].weight;
+				split = i + 1;
+			}
+
+			Box first{ box.begin, split, 0, 0 }, second{ split, box.end, 0, 0 };
+			measure(first);
+			measure(second);
+			*widest = first;
+			boxes.push_back(second);
+		}
+
+		std::vector<sf::Uint8> entries;
+		for (size_t b = 0; b < boxes.size(); ++b)
+		{
+			double sums[4] = { 0 }, weight = 0;
+			for (size_t i = boxes[b].begin; i < boxes[b].end; ++i)
+			{
+				weight += used[i].weight;
+				for (size_t c = 0; c < 4; ++c)
+					sums[c] += static_cast<double>(used[i].color[c]) * used[i].weight;
+			}
+			for (size_t c = 0; c < 4; ++c)
+				entries.push_back(weight > 0 ? static_cast<sf::Uint8>(std::min(255.0, sums[c] / weight + 0.5)) : 0);
+		}
+		return entries;
+	}
+
+	// palette indices of every pixel, rows are mapped in parallel unless the error is diffused
+	std::vector<sf::Uint8> mapToPalette(const Bitmap& image, const Palette& palette, const Dither dither)
+	{
+		static const int bayer[4][4] = { { 0, 8, 2, 10 }, { 12, 4, 14, 6 }, { 3, 11, 1, 9 }, { 15, 7, 13, 5 } };
+		std::vector<sf::Uint8> indices(static_cast<size_t>(image.size.x) * image.size.y);
+		if (dither != Dither::Diffusion)
+		{
+			util::parallelFor(image.size.y, [&](const size_t y)
+			{
+				const sf::Uint8* row = image.row(static_cast<unsigned int>(y));
+				for (unsigned int x = 0; x < image.size.x; ++x)
+				{
+					const int offset = dither == Dither::Ordered ? bayer[y & 3][x & 3] * 2 - 15 : 0;
+					int color[4];
+					for (size_t c = 0; c < 4; ++c)
+						color[c] = row[x * 4 + c] + offset;
+					indices[y * image.size.x + x] = palette.nearest(color);
+				}
+			});
+			return indices;
+		}
+
+		// floyd-steinberg in 16ths, with a pixel of padding on both sides
+		std::vector<int> errors((static_cast<size_t>(image.size.x) + 2) * 4, 0), next(errors.size(), 0);
+		for (unsigned int y = 0; y < image.size.y; ++y)
+		{
+			std::fill(next.begin(), next.end(), 0);
+			const sf::Uint8* row = image.row(y);
+			for (unsigned int x = 0; x < image.size.x; ++x)
+			{
+				int color[4];
+				for (size_t c = 0; c < 4; ++c)
+					color[c] = std::min(255, std::max(0, row[x * 4 + c] + errors[(x + 1) * 4 + c] / 16));
+				const sf::Uint8 index = palette.nearest(color);
+				indices[static_cast<size_t>(y) * image.size.x + x] = index;
+				for (size_t c = 0; c < 4; ++c)
+				{
+					const size_t i = (x + 1) * 4 + c;
+					const int error = color[c] - palette.getEntries()[index * 4 + c];
+					errors[i + 4] += 7 * error;
+					next[i - 4] += 3 * error;
+					next[i] += 5 * error;
+					next[i + 4] += error;
+				}
+			}
+			std::swap(errors, next);
+		}
+		return indices;
+	}
+
+	// collects the page, then writes it as an 8 bit indexed PNG
+	class IndexedPngWriter : public ImageWriter
+	{
+		std::string _path;
+		Bitmap _image;
+		unsigned int _written = 0;
+		int _level;
+		size_t _threads;
+		Dither _dither;
+
+	public:
+		IndexedPngWriter(const std::string& path, const sf::Vector2u& size, const int level = 6, const size_t threads = 0, const Dither dither = Dither::None) :
+			_path(path),
+			_image(size),
+			_level(level),
+			_threads(threads),
+			_dither(dither)
+		{}
+
+		bool writeRows(const sf::Uint8* rows, const unsigned int count) override
+		{
+			std::memcpy(_image.row(_written), rows, static_cast<size_t>(count) * _image.stride());
+			_written += count;
+			return true;
+		}
+		bool finish() override
+		{
+			// an exact palette needs no dithering, everything else is quantized
+			std::vector<sf::Uint8> entries;
+			const bool exact = findExactPalette(_image, entries);
+			if (!exact)
+				entries = medianCutPalette(_image, 256);
+			if (entries.empty())
+				entries.assign(4, 0);
+
+			const Palette palette(entries);
+			const std::vector<sf::Uint8> indices = mapToPalette(_image, palette, exact ? Dither::None : _dither);
+			PngWriter writer(_path, _image.size, palette.getEntries(), _level, _threads);
+			writer.writeIndices(indices.data(), _image.size.y);
+			return writer.finish();
+		}
+	};
+
+	std::unique_ptr<ImageWriter> createImageWriter(const std::string& path, const sf::Vector2u& size, const int compressionLevel = 6, const size_t threads = 0,
+		const TextureFormat format = TextureFormat::RGBA8, const bool indexed = false, const Dither dither = Dither::None, const ColorConverter& color = ColorConverter())
+	{
+		std::string extension = path.substr(path.rfind('.') + 1);
+		std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+		if (extension == "png" && indexed)
+			return std::unique_ptr<ImageWriter>(new IndexedPngWriter(path, size, compressionLevel, threads, dither));
+		if (extension == "png")
+			return std::unique_ptr<ImageWriter>(new PngWriter(path, size, compressionLevel, threads, format));
+		TextureContainer container;
+		if (textureContainerOf(path, container))
+			return std::unique_ptr<ImageWriter>(new TextureWriter(path, size, format, container, threads, color));
+		if (extension == "tga" && size.x <= 0xFFFF && size.y <= 0xFFFF)
+			return std::unique_ptr<ImageWriter>(new TgaWriter(path, size, format));
+		return std::unique_ptr<ImageWriter>(new BufferedWriter(path, size));
+	}
+
+	// cuts a page into tiles of tileSize texels with a border copied from the neighbouring texels (clamped at the page edge),
+	// only tiles holding a non-zero texel are written, and a page table maps every tile slot to the tile stored for it
+	class TileWriter : public ImageWriter
+	{
+	public:
+		typedef std::function<std::unique_ptr<ImageWriter>(const std::string&, const sf::Vector2u&)> Open;
+
+	private:
+		std::string _path;
+		sf::Vector2u _size;
+		unsigned int _tile, _border, _columns, _rows;
+		Open _open;
+		size_t _threads;
+		// page rows from _first on, as many as have arrived and are still needed
+		std::vector<sf::Uint8> _buffer;
+		unsigned int _first = 0, _received = 0, _nextRow = 0;
+		std::vector<sf::Uint32> _table;
+		sf::Uint32 _stored = 0;
+		std::atomic<bool> _ok{ true };
+
+		inline const sf::Uint8* _pixel(const int x, const int y) const
+		{
+			const unsigned int cx = static_cast<unsigned int>(std::min(std::max(x, 0), static_cast<int>(_size.x) - 1));
+			const unsigned int cy = static_cast<unsigned int>(std::min(std::max(y, 0), static_cast<int>(_size.y) - 1));
+			return _buffer.data() + (static_cast<size_t>(cy - _first) * _size.x + cx) * 4;
+		}
+
+		void _cutRow(const unsigned int ty)
+		{
+			const unsigned int top = ty * _tile, bottom = std::min(top + _tile, _size.y);
+			std::vector<char> used(_columns, 0);
+			util::parallelFor(_columns, [&](const size_t tx)
+			{
+				const unsigned int left = static_cast<unsigned int>(tx) * _tile, right = std::min(left + _tile, _size.x);
+				for (unsigned int y = top; y < bottom && !used[tx]; ++y)
+				{
+					const sf::Uint8* row = _pixel(left, y);
+					used[tx] = std::any_of(row, row + (right - left) * 4, [](const sf::Uint8 v) { return v != 0; });
+				}
+			}, _threads);
+
+			// tiles are numbered in the order of their slots, the table stores that number plus one, zero for an empty slot
+			std::vector<unsigned int> columns;
+			for (unsigned int tx = 0; tx < _columns; ++tx)
+				if (used[tx])
+				{
+					_table[static_cast<size_t>(ty) * _columns + tx] = ++_stored;
+					columns.push_back(tx);
+				}
+
+			const unsigned int side = _tile + 2 * _border;
+			util::parallelFor(columns.size(), [&](const size_t c)
+			{
+				const int left = static_cast<int>(columns[c] * _tile) - static_cast<int>(_border), upper = static_cast<int>(top) - static_cast<int>(_border);
+				Bitmap tile(sf::Vector2u(side, side));
+				for (unsigned int y = 0; y < side; ++y)
+					for (unsigned int x = 0; x < side; ++x)
+						std::memcpy(tile.row(y) + x * 4, _pixel(left + static_cast<int>(x), upper + static_cast<int>(y)), 4);
+
+				std::unique_ptr<ImageWriter> writer = _open(tilePath(_path, columns[c], ty), tile.size);
+				if (!writer->writeRows(tile.pixels.data(), side) || !writer->finish())
+					_ok = false;
+			}, _threads);
+		}
+
+	public:
+		TileWriter(const std::string& path, const sf::Vector2u& size, const unsigned int tileSize, const unsigned int border, const Open& open, const size_t threads = 0) :
+			_path(path),
+			_size(size),
+			_tile(std::max(1u, tileSize)),
+			_border(border),
+			_open(open),
+			_threads(threads)
+		{
+			_columns = (size.x + _tile - 1) / _tile;
+			_rows = (size.y + _tile - 1) / _tile;
+			_table.assign(static_cast<size_t>(_columns) * _rows, 0);
+		}
 
-		return (dwAttrib != INVALID_FILE_ATTRIBUTES &&
-			(dwAttrib & FILE_ATTRIBUTE_DIRECTORY));
-	}
+		// atlas.png -> atlas_t3_5.png
+		static std::string tilePath(const std::string& path, const unsigned int x, const unsigned int y)
+		{
+			const size_t dot = path.rfind('.');
+			const std::string suffix = "_t" + std::to_string(x) + '_' + std::to_string(y);
+			return dot == std::string::npos ? path + suffix : path.substr(0, dot) + suffix + path.substr(dot);
+		}
 
-	std::wstring getAvailableDir(std::wstring path)
-	{
-		unsigned short int cnt = 1;
-		std::wstring copyTemp = path;
-		while (directoryExists(path.c_str()))
+		bool writeRows(const sf::Uint8* rows, const unsigned int count) override
 		{
-			path = copyTemp + L'(' + std::to_wstring(cnt) + L')';
-			++cnt;
+			_buffer.insert(_buffer.end(), rows, rows + static_cast<size_t>(count) * _size.x * 4);
+			_received += count;
+
+			// a row of tiles is cut once its bottom border has arrived, rows above the next one's top border are dropped
+			while (_nextRow < _rows && _received >= std::min(_size.y, (_nextRow + 1) * _tile + _border))
+			{
+				_cutRow(_nextRow++);
+				const unsigned int keep = std::min(_received, static_cast<unsigned int>(std::max(0, static_cast<int>(_nextRow * _tile) - static_cast<int>(_border))));
+				if (keep > _first)
+				{
+					_buffer.erase(_buffer.begin(), _buffer.begin() + static_cast<size_t>(keep - _first) * _size.x * 4);
+					_first = keep;
+				}
+			}
+			return _ok;
 		}
-		return path;
-	}
 
-	std::string getWD()
-	{
-		wchar_t result[MAX_PATH];
-		GetModuleFileName(NULL, result, MAX_PATH);
-		return util::toString(std::wstring(result).substr(0, std::wstring(result).rfind('\\')));
-	}
+		// the page table next to the page, atlas.ptab: "PTAB", tile size, border, columns and rows, then a 32 bit entry per slot
+		bool finish() override
+		{
+			while (_nextRow < _rows && _received > _nextRow * _tile)
+				_cutRow(_nextRow++);
 
+			std::ofstream out(_path.substr(0, _path.rfind('.')) + ".ptab", std::ios::binary);
+			out.write("PTAB", 4);
+			_putLE(out, _tile, 4);
+			_putLE(out, _border, 4);
+			_putLE(out, _columns, 4);
+			_putLE(out, _rows, 4);
+			for (size_t i = 0; i < _table.size(); ++i)
+				_putLE(out, _table[i], 4);
+			out.close();
+			return _ok && !out.fail();
+		}
+	};
 }
 
 namespace img
@@ -394,6 +3649,11 @@ namespace img
 	public:
 		std::string nameTag;
 		sf::Vector2f position, scale;
+		sf::IntRect trim;
+		bool rotated = false;
+		int group = 0;
+		size_t page = 0;
+		int channel = -1;
 		bool isValid = false;
 
 		ImageBoxData()
@@ -406,14 +3666,147 @@ namespace img
 		{}
 	};
 
+	// decoded pixels of an image file, shared by every box showing it, the textures are only display caches of it
+	class PixelStore
+	{
+		class Scaled
+		{
+		public:
+			sf::IntRect region;
+			sf::Vector2u size;
+			px::Filter filter;
+			bool linear;
+			px::Bitmap bitmap;
+		};
+
+		mutable std::mutex _mutex;
+		mutable std::list<Scaled> _scaled;
+		mutable std::vector<std::unique_ptr<const px::Bitmap>> _levels;
+
+	public:
+		// a few scales per image are enough for packing and exporting at the current settings
+		static const size_t MaxScaled = 4;
+		const px::Bitmap pixels;
+
+		PixelStore(const sf::Image& image) :
+			pixels(image)
+		{}
+
+		// resampled pixels of a region, the last few results are kept so exporting again at the same scale is a copy,
+		// unless cache is off, which the streaming export uses so a sprite is gone once its last band is written
+		px::Bitmap getScaled(const sf::IntRect& region, const sf::Vector2u& size, const px::Filter filter, const bool linear, const bool cache = true) const
+		{
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				for (auto it = _scaled.begin(); it != _scaled.end(); ++it)
+					if (it->region == region && it->size == size && it->filter == filter && it->linear == linear)
+					{
+						_scaled.splice(_scaled.begin(), _scaled, it);
+						return it->bitmap;
+					}
+			}
+
+			px::Bitmap result(size);
+			px::resample(pixels.pixels.data() + region.top * pixels.stride() + region.left * 4, region.width, region.height, pixels.stride(),
+				result.pixels.data(), size.x, size.y, result.stride(), filter, linear);
+			if (!cache)
+				return result;
+
+			std::lock_guard<std::mutex> lock(_mutex);
+			_scaled.push_front(Scaled{ region, size, filter, linear, result });
+			if (_scaled.size() > MaxScaled)
+				_scaled.pop_back();
+			return result;
+		}
+
+		// mip pyramid for displaying the image zoomed out, level 0 is the image, every level halves the previous one down to 1x1
+		inline size_t getLevelCount() const
+		{
+			size_t count = 1;
+			for (unsigned int side = std::max(pixels.size.x, pixels.size.y); side > 1; side >>= 1)
+				++count;
+			return count;
+		}
+		const px::Bitmap& getLevel(const size_t level) const
+		{
+			if (level == 0)
+				return pixels;
+
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (_levels.size() < level)
+				_levels.resize(level);
+			for (size_t i = 0; i < level; ++i)
+				if (!_levels[i])
+				{
+					const px::Bitmap& larger = i ? *_levels[i - 1] : pixels;
+					std::unique_ptr<px::Bitmap> smaller(new px::Bitmap(sf::Vector2u(std::max(1u, larger.size.x / 2), std::max(1u, larger.size.y / 2))));
+					px::resample(larger.pixels.data(), larger.size.x, larger.size.y, larger.stride(),
+						smaller->pixels.data(), smaller->size.x, smaller->size.y, smaller->stride(), px::Filter::Box);
+					_levels[i] = std::move(smaller);
+				}
+			return *_levels[level - 1];
+		}
+	};
+
 	class ImageBox
 	{
 		bool _isSelected = false;
 		mutable bool _isOverlapped = false;
+		int _group = 0;
+		size_t _page = 0;
+		int _channel = -1;
 		std::string _nameTag;
-		sf::Texture _tx;
+		std::shared_ptr<const PixelStore> _pixels;
+		// the textures hold one level of the pixel store's pyramid, the sprite has no texture and only carries the geometry
+		static const size_t NoLevel = static_cast<size_t>(-1);
+		size_t _level = NoLevel;
+		// levels larger than the driver allows for a single texture are split into a grid of tiles, row by row
+		std::vector<sf::Texture> _tiles;
+		sf::Vector2u _levelSize;
+		unsigned int _tileSize = 0, _tileColumns = 0;
 		sf::Sprite _sp;
 
+		// picks the smallest level that still has a texel per screen pixel at the current scale
+		void _updateProxy()
+		{
+			const float scale = std::max(std::abs(_sp.getScale().x), std::abs(_sp.getScale().y));
+			size_t level = 0;
+			while (level + 1 < _pixels->getLevelCount() && scale * static_cast<float>(2u << level) <= 1.0f)
+				++level;
+			if (level == _level)
+				return;
+
+			const px::Bitmap& bitmap = _pixels->getLevel(level);
+			_levelSize = bitmap.size;
+			_tileSize = sf::Texture::getMaximumSize();
+			_tileColumns = (bitmap.size.x + _tileSize - 1) / _tileSize;
+			const unsigned int rows = (bitmap.size.y + _tileSize - 1) / _tileSize;
+			_tiles.resize(static_cast<size_t>(_tileColumns) * rows);
+
+			std::vector<sf::Uint8> staging;
+			for (unsigned int ty = 0; ty < rows; ++ty)
+				for (unsigned int tx = 0; tx < _tileColumns; ++tx)
+				{
+					const unsigned int left = tx * _tileSize, top = ty * _tileSize;
+					const sf::Vector2u size(std::min(_tileSize, bitmap.size.x - left), std::min(_tileSize, bitmap.size.y - top));
+					sf::Texture& tile = _tiles[ty * _tileColumns + tx];
+					if (tile.getSize() != size)
+						tile.create(size.x, size.y);
+
+					// a tile as wide as the level is already contiguous in the store
+					if (_tileColumns == 1)
+						tile.update(bitmap.row(top));
+					else
+					{
+						staging.resize(static_cast<size_t>(size.x) * size.y * 4);
+						for (unsigned int y = 0; y < size.y; ++y)
+							std::memcpy(staging.data() + static_cast<size_t>(y) * size.x * 4, bitmap.row(top + y) + left * 4, static_cast<size_t>(size.x) * 4);
+						tile.update(staging.data());
+					}
+				}
+			_level = level;
+		}
+
 	public:
 		ImageBox(const std::string& nameTag, const std::string& sourcefile = "") :
 			_nameTag(nameTag)
@@ -422,9 +3815,10 @@ namespace img
 		}
 
 		ImageBox(const ImageBox& other) :
-			_tx(other._tx),
-			_sp(_tx)
-		{}
+			_pixels(other._pixels)
+		{
+			resetTrim();
+		}
 
 		ImageBox(const ImageBoxData& data, const std::string& imageDir) :
 			_nameTag(data.nameTag)
@@ -432,19 +3826,79 @@ namespace img
 			setImage(imageDir + "\\" + _nameTag + ".png");
 			_sp.setPosition(data.position);
 			_sp.setScale(data.scale);
+			if (data.trim.width > 0 && data.trim.height > 0)
+				setTrim(data.trim);
+			setRotated(data.rotated);
+			_group = data.group;
+			_page = data.page;
+			_channel = data.channel;
+		}
+
+		// shown while an image is being decoded and when a file fails to load
+		static std::shared_ptr<const PixelStore> getPlaceholder()
+		{
+			static const std::shared_ptr<const PixelStore> placeholder = []()
+			{
+				sf::Image image;
+				image.loadFromFile("iconsc.png");
+				return std::make_shared<const PixelStore>(image);
+			}();
+			return placeholder;
 		}
 
 		void setImage(const std::string& sourcefile)
 		{
-			if (sourcefile.length() == 0 || !_tx.loadFromFile(sourcefile))
-				_tx.loadFromFile("iconsc.png");
-			_sp.setTexture(_tx);
+			sf::Image image;
+			if (sourcefile.length() == 0 || !image.loadFromFile(sourcefile))
+				setPixels(getPlaceholder());
+			else
+				setPixels(std::make_shared<const PixelStore>(image));
+		}
+		// the texture is uploaded by the next draw, which has to run on the thread owning the window
+		void setPixels(const std::shared_ptr<const PixelStore>& pixels)
+		{
+			_pixels = pixels;
+			_level = NoLevel;
+			resetTrim();
+			setRotated(isRotated());
+		}
+
+		// only the trimmed part of the texture is displayed, packed and exported
+		inline void setTrim(const sf::IntRect& rect) { _sp.setTextureRect(rect); }
+		inline void resetTrim() { _sp.setTextureRect(sf::IntRect(0, 0, _pixels->pixels.size.x, _pixels->pixels.size.y)); }
+		inline sf::IntRect getTrim() const { return _sp.getTextureRect(); }
+		inline bool isTrimmed() const { return _sp.getTextureRect() != sf::IntRect(0, 0, _pixels->pixels.size.x, _pixels->pixels.size.y); }
+
+		// rotated images are turned 90 degrees clockwise, the origin keeps the position at the top left of the bounds
+		inline void setRotated(const bool rotated)
+		{
+			_sp.setRotation(rotated ? 90.0 : 0.0);
+			_sp.setOrigin(0.0, rotated ? static_cast<float>(getTrim().height) : 0.0);
+		}
+		inline bool isRotated() const { return _sp.getRotation() != 0.0; }
+
+		// images sharing a non-zero group are kept on the same atlas page when packing
+		inline void setGroup(const int group) { _group = group; }
+		inline int getGroup() const { return _group; }
+		inline void setPage(const size_t page) { _page = page; }
+		inline size_t getPage() const { return _page; }
+		// single channel images packed into one channel of the atlas (0-3 for r, g, b, a), -1 when the image owns all four
+		inline void setChannel(const int channel) { _channel = channel; }
+		inline int getChannel() const { return _channel; }
+		inline const std::shared_ptr<const PixelStore>& getPixels() const { return _pixels; }
+		inline bool isSingleChannel() const { return px::isSingleChannel(_pixels->pixels.pixels.data(), _pixels->pixels.size, _pixels->pixels.stride()); }
+
+		sf::IntRect getOpaqueBounds(const sf::Uint8 alphaThreshold) const
+		{
+			return px::findOpaqueBounds(_pixels->pixels.pixels.data(), _pixels->pixels.size, alphaThreshold);
 		}
 
 		inline sf::Vector2f getPosition() const { return _sp.getPosition(); }
-		inline sf::Vector2f getSize() const { return static_cast<sf::Vector2f>(_tx.getSize()); }
+		inline sf::Vector2f getSize() const { return static_cast<sf::Vector2f>(_pixels->pixels.size); }
 		inline sf::Vector2f getScaledSize() const { return sf::Vector2f(_sp.getGlobalBounds().width, _sp.getGlobalBounds().height); }
 		inline sf::Vector2f getScale() const { return _sp.getScale(); }
+		inline sf::Vector2f getTrimOffset() const { return sf::Vector2f(getTrim().left * _sp.getScale().x, getTrim().top * _sp.getScale().y); }
+		inline sf::Vector2f getUntrimmedSize() const { return sf::Vector2f(_pixels->pixels.size.x * _sp.getScale().x, _pixels->pixels.size.y * _sp.getScale().y); }
 		inline sf::FloatRect getBounds() const { return _sp.getGlobalBounds(); }
 		inline std::string getNameTag() const { return _nameTag; }
 		inline bool isSelected() const { return _isSelected; }
@@ -464,31 +3918,75 @@ namespace img
 		{
 			return _sp;
 		}
-		inline const sf::Image getImage() const
+		// the image the way it is placed in the atlas, trimmed, scaled and rotated
+		inline px::Bitmap getBitmap(const px::Filter filter = px::Filter::Lanczos3, const bool linear = false, const bool cache = true) const
 		{
-			if (_sp.getScale() == sf::Vector2f(1.0, 1.0))
-				return _tx.copyToImage();
+			px::Bitmap bitmap = getBitmap(getTrim(), filter, linear, cache);
+			if (!isRotated())
+				return bitmap;
 
-			const sf::Image original = _tx.copyToImage();
-			sf::Image result;
-			result.create(_sp.getGlobalBounds().width, _sp.getGlobalBounds().height, sf::Color(0, 0, 0, 0));
-			const sf::Vector2u originalImageSize(original.getSize());
-			const sf::Vector2u resizedImageSize(_sp.getGlobalBounds().width, _sp.getGlobalBounds().height);
-			for (unsigned int y = 0; y < resizedImageSize.y; ++y)
+			px::Bitmap rotated(sf::Vector2u(bitmap.size.y, bitmap.size.x));
+			px::rotateClockwise(bitmap.pixels.data(), bitmap.size.x, bitmap.size.y, bitmap.stride(), rotated.pixels.data(), rotated.stride());
+			return rotated;
+		}
+		// size of what getBitmap returns, without producing the pixels
+		sf::Vector2u getBitmapSize() const
+		{
+			const sf::IntRect trim = getTrim();
+			sf::Vector2u size(trim.width, trim.height);
+			if (_sp.getScale() != sf::Vector2f(1.0, 1.0))
+				size = sf::Vector2u(trim.width * _sp.getScale().x, trim.height * _sp.getScale().y);
+			return isRotated() ? sf::Vector2u(size.y, size.x) : size;
+		}
+		// scaled pixels of the given texture region
+		px::Bitmap getBitmap(const sf::IntRect& textureRect, const px::Filter filter = px::Filter::Lanczos3, const bool linear = false, const bool cache = true) const
+		{
+			if (_sp.getScale() == sf::Vector2f(1.0, 1.0))
 			{
-				for (unsigned int x = 0; x < resizedImageSize.x; ++x)
-				{
-					unsigned int origX{ static_cast<unsigned int>(static_cast<double>(x) / resizedImageSize.x * originalImageSize.x) };
-					unsigned int origY{ static_cast<unsigned int>(static_cast<double>(y) / resizedImageSize.y * originalImageSize.y) };
-					result.setPixel(x, y, original.getPixel(origX, origY));
-				}
+				const px::Bitmap& source = _pixels->pixels;
+				px::Bitmap result(sf::Vector2u(textureRect.width, textureRect.height));
+				for (unsigned int y = 0; y < result.size.y; ++y)
+					std::memcpy(result.row(y), source.row(textureRect.top + y) + textureRect.left * 4, result.stride());
+				return result;
 			}
-			return result;
+
+			return _pixels->getScaled(textureRect, sf::Vector2u(textureRect.width * _sp.getScale().x, textureRect.height * _sp.getScale().y), filter, linear, cache);
+		}
+		inline const sf::Image getImage(const px::Filter filter = px::Filter::Lanczos3, const bool linear = false) const
+		{
+			return getBitmap(filter, linear).toImage();
 		}
 
 		void draw(sf::RenderWindow& window)
 		{
-			window.draw(_sp);
+			// the trim rect mapped onto the proxy level, scaled back up to the size of the sprite
+			_updateProxy();
+			const sf::IntRect trim = getTrim();
+			const float fx = static_cast<float>(_levelSize.x) / _pixels->pixels.size.x, fy = static_cast<float>(_levelSize.y) / _pixels->pixels.size.y;
+			const int left = static_cast<int>(trim.left * fx), top = static_cast<int>(trim.top * fy);
+			const sf::IntRect rect(left, top,
+				std::max(1, static_cast<int>(std::ceil((trim.left + trim.width) * fx)) - left),
+				std::max(1, static_cast<int>(std::ceil((trim.top + trim.height) * fy)) - top));
+
+			sf::Transformable proxy;
+			proxy.setPosition(_sp.getPosition());
+			proxy.setRotation(_sp.getRotation());
+			proxy.setScale(_sp.getScale().x * trim.width / rect.width, _sp.getScale().y * trim.height / rect.height);
+			proxy.setOrigin(0.0, isRotated() ? static_cast<float>(rect.height) : 0.0);
+			const sf::RenderStates states(proxy.getTransform());
+
+			// every tile draws its part of the rect at its offset inside the proxy
+			for (size_t i = 0; i < _tiles.size(); ++i)
+			{
+				const sf::IntRect tileRect((i % _tileColumns) * _tileSize, (i / _tileColumns) * _tileSize, _tiles[i].getSize().x, _tiles[i].getSize().y);
+				sf::IntRect part;
+				if (!rect.intersects(tileRect, part))
+					continue;
+
+				sf::Sprite piece(_tiles[i], sf::IntRect(part.left - tileRect.left, part.top - tileRect.top, part.width, part.height));
+				piece.setPosition(part.left - rect.left, part.top - rect.top);
+				window.draw(piece, states);
+			}
 			if (_isOverlapped)
 			{
 				sf::FloatRect bounds = _sp.getGlobalBounds();
@@ -517,11 +4015,19 @@ namespace img
 				+ std::to_string(_sp.getPosition().x) + ':'
 				+ std::to_string(_sp.getPosition().y) + ':'
 				+ std::to_string(_sp.getScale().x / scaleOffset.x) + ':'
-				+ std::to_string(_sp.getScale().y / scaleOffset.x);
+				+ std::to_string(_sp.getScale().y / scaleOffset.x) + ':'
+				+ std::to_string(getTrim().left) + ':'
+				+ std::to_string(getTrim().top) + ':'
+				+ std::to_string(getTrim().width) + ':'
+				+ std::to_string(getTrim().height) + ':'
+				+ std::to_string(isRotated()) + ':'
+				+ std::to_string(_group) + ':'
+				+ std::to_string(_page) + ':'
+				+ std::to_string(_channel);
 		}
 		void saveToFile(const std::string& path) const
 		{
-			_tx.copyToImage().saveToFile(path + "\\" + _nameTag + ".png");
+			_pixels->pixels.toImage().saveToFile(path + "\\" + _nameTag + ".png");
 		}
 
 		static ImageBoxData deserialize(const std::string& line)
@@ -546,7 +4052,43 @@ namespace img
 				data.scale.x = std::stof(line.substr(last + 1, next));
 				last = next;
 
-				data.scale.y = std::stof(line.substr(last + 1));
+				next = line.find(':', last + 1);
+				data.scale.y = std::stof(line.substr(last + 1, next));
+				last = next;
+
+				// trim rect is optional, older files don't have it
+				if (next != std::string::npos)
+				{
+					int* const trim[] = { &data.trim.left, &data.trim.top, &data.trim.width, &data.trim.height };
+					for (size_t i = 0; i < 4; ++i)
+					{
+						next = line.find(':', last + 1);
+						*trim[i] = std::stoi(line.substr(last + 1, next));
+						last = next;
+					}
+				}
+				if (next != std::string::npos)
+				{
+					next = line.find(':', last + 1);
+					data.rotated = std::stoi(line.substr(last + 1, next)) != 0;
+					last = next;
+				}
+				if (next != std::string::npos)
+				{
+					next = line.find(':', last + 1);
+					data.group = std::stoi(line.substr(last + 1, next));
+					last = next;
+
+					next = line.find(':', last + 1);
+					data.page = std::stoul(line.substr(last + 1, next));
+					last = next;
+				}
+				if (next != std::string::npos)
+				{
+					next = line.find(':', last + 1);
+					data.channel = std::stoi(line.substr(last + 1, next));
+					last = next;
+				}
 			}
 			catch (...)
 			{
@@ -573,10 +4115,166 @@ namespace img
 	};
 	size_t ImageBox::instanceCount = 0;
 
+	class DecodedImage
+	{
+	public:
+		size_t ticket;
+		std::shared_ptr<const PixelStore> pixels;
+	};
+
+	// decoded images of one image vector, the workers keep it alive if the vector is gone before they finish
+	class DecodeQueue
+	{
+		std::mutex _mutex;
+		std::condition_variable _cv;
+		std::deque<DecodedImage> _done;
+
+	public:
+		void push(DecodedImage&& image)
+		{
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_done.push_back(std::move(image));
+			}
+			_cv.notify_one();
+		}
+		bool tryPop(DecodedImage& image)
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (_done.empty())
+				return false;
+			image = std::move(_done.front());
+			_done.pop_front();
+			return true;
+		}
+		DecodedImage waitPop()
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_cv.wait(lock, [this]() { return !_done.empty(); });
+			DecodedImage image = std::move(_done.front());
+			_done.pop_front();
+			return image;
+		}
+	};
+
+	// decodes image files on worker threads, textures are uploaded later by whoever drains the queue
+	class ImageDecoder
+	{
+		class Job
+		{
+		public:
+			size_t ticket;
+			std::string path;
+			std::shared_ptr<DecodeQueue> queue;
+		};
+
+		std::mutex _mutex;
+		std::condition_variable _cv;
+		std::deque<Job> _jobs;
+		std::vector<std::thread> _workers;
+		bool _stop = false;
+
+		void _work()
+		{
+			while (true)
+			{
+				Job job;
+				{
+					std::unique_lock<std::mutex> lock(_mutex);
+					_cv.wait(lock, [this]() { return _stop || !_jobs.empty(); });
+					if (_stop)
+						return;
+					job = std::move(_jobs.front());
+					_jobs.pop_front();
+				}
+
+				sf::Image image;
+				if (image.loadFromFile(job.path))
+					job.queue->push(DecodedImage{ job.ticket, std::make_shared<const PixelStore>(image) });
+				else
+					job.queue->push(DecodedImage{ job.ticket, ImageBox::getPlaceholder() });
+			}
+		}
+
+		ImageDecoder()
+		{
+			// one core stays with the editor
+			const unsigned int count = std::max(2u, std::thread::hardware_concurrency()) - 1;
+			for (unsigned int i = 0; i < count; ++i)
+				_workers.emplace_back(&ImageDecoder::_work, this);
+		}
+
+	public:
+		~ImageDecoder()
+		{
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_stop = true;
+			}
+			_cv.notify_all();
+			for (size_t i = 0; i < _workers.size(); ++i)
+				_workers[i].join();
+		}
+
+		static ImageDecoder& instance()
+		{
+			static ImageDecoder decoder;
+			return decoder;
+		}
+
+		void decode(const size_t ticket, const std::string& path, const std::shared_ptr<DecodeQueue>& queue)
+		{
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_jobs.push_back(Job{ ticket, path, queue });
+			}
+			_cv.notify_one();
+		}
+	};
+
+	class ExportSettings
+	{
+	public:
+		bool createMapFile, emitPolygons, bleedAlpha = false, linearScaling = false;
+		unsigned int extrude = 0;
+		px::Filter filter = px::Filter::Lanczos3;
+		// PNG deflate level (0-9) and the number of threads compressing it, 0 for all cores
+		int compressionLevel = 6;
+		unsigned int compressionThreads = 0;
+		// block formats only apply to .dds and .ktx2, the reduced precision ones to every output
+		px::TextureFormat format = px::TextureFormat::RGBA8;
+		px::Dither dither = px::Dither::None;
+		// 8 bit palette PNGs, exact when the atlas has 256 colours or fewer
+		bool indexed = false;
+		// colour the renderer can sample without converting it on load, flagged in the map file
+		bool premultiply = false;
+		px::Transfer transfer = px::Transfer::Unchanged;
+		// the other open atlases are exported as channel sets of this one (normal, roughness...) with its layout
+		bool sharedLayout = false;
+		// names of the channel sets written next to the atlas, listed in its map file
+		std::vector<std::string> channelSets;
+		// @1x up to @<variantScale>x versions of the atlas, all from the one layout packed at the highest scale
+		unsigned int variantScale = 1;
+		// equal size pages written as the layers of a single .ktx2 array texture
+		bool textureArray = false;
+		// pages cut into square tiles for a virtual texture, empty ones left out of the page table; 0 for whole pages
+		unsigned int tileSize = 0, tileBorder = 4;
+		unsigned int mipLevels = 1;
+
+		ExportSettings(const bool createMapFile = true, const bool emitPolygons = false) :
+			createMapFile(createMapFile),
+			emitPolygons(emitPolygons)
+		{}
+	};
+
 	class ImageVector
 	{
 		bool _anySelected = false;
 		std::vector<ImageBox*> _images;
+		std::vector<sf::IntRect> _pages;
+		// boxes still showing the placeholder, by decode ticket
+		std::map<size_t, ImageBox*> _loading;
+		std::shared_ptr<DecodeQueue> _decoded = std::make_shared<DecodeQueue>();
 		sf::Vector2f _position;
 		sf::Vector2f _scale;
 
@@ -605,19 +4303,22 @@ namespace img
 			_scale(scale)
 		{}
 
-		ImageVector(const ImageVector& other) :
-			_position(other._position),
-			_scale(other._scale)
-		{
-			for (size_t i = 0; i < other._images.size(); ++i)
-				addImage(*new ImageBox(*other._images[i]), i == 0);
-		}
-
-		ImageVector(ImageVector&& other) :
+		// boxes still loading belong to the decode queue of the vector that started them, so a vector is moved, never copied,
+		// and the tabs holding one reallocate without dropping the link to their pending decodes
+		ImageVector(const ImageVector&) = delete;
+		ImageVector& operator=(const ImageVector&) = delete;
+
+		ImageVector(ImageVector&& other) noexcept :
+			_anySelected(other._anySelected),
+			_images(std::move(other._images)),
+			_pages(std::move(other._pages)),
+			_loading(std::move(other._loading)),
+			_decoded(std::move(other._decoded)),
 			_position(other._position),
 			_scale(other._scale)
 		{
-			mergeWith(std::move(other));
+			other._images.clear();
+			other._loading.clear();
 		}
 
 		~ImageVector()
@@ -633,9 +4334,14 @@ namespace img
 			other._images.clear();
 		}
 
+		// the box shows a placeholder until the file is decoded, see applyDecoded
 		inline void addImage(const std::string& name, const std::string& sourcefile, const bool resetPosition, const bool resetProperties = true)
 		{
-			_images.push_back(new ImageBox(name, sourcefile));
+			static size_t nextTicket = 0;
+
+			_images.push_back(new ImageBox(name));
+			_loading[++nextTicket] = _images.back();
+			ImageDecoder::instance().decode(nextTicket, sourcefile, _decoded);
 
 			if (resetProperties)
 			{
@@ -667,6 +4373,12 @@ namespace img
 
 		inline void deleteImage(const size_t idx)
 		{
+			for (auto it = _loading.begin(); it != _loading.end(); ++it)
+				if (it->second == _images[idx])
+				{
+					_loading.erase(it);
+					break;
+				}
 			delete _images[idx];
 			_images.erase(_images.begin() + idx);
 		}
@@ -680,8 +4392,39 @@ namespace img
 				}
 		}
 
+		inline bool isLoading() const { return !_loading.empty(); }
+		// uploads decoded images until the budget of the frame is spent
+		void applyDecoded(const sf::Clock& frame, const sf::Time& budget)
+		{
+			DecodedImage image;
+			while (!_loading.empty() && frame.getElapsedTime() < budget && _decoded->tryPop(image))
+			{
+				auto it = _loading.find(image.ticket);
+				if (it == _loading.end())
+					continue;
+				it->second->setPixels(image.pixels);
+				_loading.erase(it);
+			}
+		}
+		// packing, saving and exporting need the real pixels
+		void finishLoading()
+		{
+			while (!_loading.empty())
+			{
+				const DecodedImage image = _decoded->waitPop();
+				auto it = _loading.find(image.ticket);
+				if (it == _loading.end())
+					continue;
+				it->second->setPixels(image.pixels);
+				_loading.erase(it);
+			}
+		}
+
 		inline sf::Vector2f getScale() const { return _scale; }
 		inline sf::Vector2f getPosition() const { return _position; }
+		// page rects are relative to the base position, a single page means the atlas is its bounds
+		inline void setPages(const std::vector<sf::IntRect>& pages) { _pages = pages; }
+		inline const std::vector<sf::IntRect>& getPages() const { return _pages; }
 		const ImageBox* getSingleSelected()
 		{
 			if (!_anySelected)
@@ -740,6 +4483,8 @@ namespace img
 					_images[i]->applyScale(scale);
 		}
 
+		// images in different channel layers may cover each other
+		static inline bool sharesChannels(const ImageBox& a, const ImageBox& b) { return a.getChannel() < 0 || b.getChannel() < 0 || a.getChannel() == b.getChannel(); }
 		void clearOverlapped() const
 		{
 			for (size_t i = 0; i < _images.size(); ++i)
@@ -752,7 +4497,7 @@ namespace img
 				clearOverlapped();
 				for (size_t i = 0; i < _images.size() - 1; ++i)
 					for (size_t j = i + 1; j < _images.size(); ++j)
-						if (_images[i]->getBounds().intersects(_images[j]->getBounds()))
+						if (sharesChannels(*_images[i], *_images[j]) && _images[i]->getBounds().intersects(_images[j]->getBounds()))
 						{
 							_images[i]->setOverlap(true);
 							_images[j]->setOverlap(true);
@@ -798,6 +4543,22 @@ namespace img
 				else
 					_images[i]->setSelect(false);
 		}
+		void groupSelected()
+		{
+			int group = 0;
+			for (size_t i = 0; i < _images.size(); ++i)
+				group = std::max(group, _images[i]->getGroup());
+			++group;
+			for (size_t i = 0; i < _images.size(); ++i)
+				if (_images[i]->isSelected())
+					_images[i]->setGroup(group);
+		}
+		void ungroupSelected()
+		{
+			for (size_t i = 0; i < _images.size(); ++i)
+				if (_images[i]->isSelected())
+					_images[i]->setGroup(0);
+		}
 		int findImage(const sf::Vector2f& point)
 		{
 			for (int i = _images.size() - 1; i >= 0; --i)
@@ -806,42 +4567,244 @@ namespace img
 			return -1;
 		}
 
-		inline void draw(sf::RenderWindow& window, const bool showOverlapped = false) const 
-		{
-			if(showOverlapped) findOverlapped();
-			for (size_t i = 0; i < _images.size(); ++i)
-				_images[i]->draw(window);
-		}
+		inline void draw(sf::RenderWindow& window, const bool showOverlapped = false) const 
+		{
+			if(showOverlapped) findOverlapped();
+			if (_pages.size() > 1)
+				for (size_t i = 0; i < _pages.size(); ++i)
+				{
+					sf::RectangleShape outline(sf::Vector2f(_pages[i].width, _pages[i].height));
+					outline.setPosition(_position + sf::Vector2f(_pages[i].left, _pages[i].top));
+					outline.setFillColor(sf::Color(0, 0, 0, 0));
+					outline.setOutlineColor(sf::Color(255, 255, 255, 120));
+					outline.setOutlineThickness(1);
+					window.draw(outline);
+				}
+			for (size_t i = 0; i < _images.size(); ++i)
+				_images[i]->draw(window);
+		}
+
+		ImageBox& operator[](std::size_t idx) { return *_images[idx]; }
+		const ImageBox& operator[](std::size_t idx) const { return *_images[idx]; }
+
+		bool exportToImage(const std::string& path, const ExportSettings& settings) const
+		{
+			if (_images.size() == 0)
+				return false;
+
+			const int extrude = settings.extrude;
+
+			// every page is written to its own file at the size of its bin, whose rects already hold the extrude ring,
+			// an atlas that was never packed covers the bounds of all images and the ring right and below them
+			// (a single page is still exported from its origin, which keeps block and mip alignment intact)
+			std::vector<sf::Vector2f> origins;
+			std::vector<sf::Vector2u> sizes;
+			if (!_pages.empty())
+			{
+				for (size_t p = 0; p < _pages.size(); ++p)
+				{
+					origins.push_back(_position + sf::Vector2f(_pages[p].left, _pages[p].top));
+					sizes.push_back(sf::Vector2u(_pages[p].width, _pages[p].height));
+				}
+			}
+			else
+			{
+				const sf::IntRect bounds = getBounds();
+				if (bounds == sf::IntRect(0, 0, 0, 0))
+					return false;
+
+				origins.push_back(sf::Vector2f(bounds.left, bounds.top));
+				sizes.push_back(sf::Vector2u(bounds.width - bounds.left + extrude, bounds.height - bounds.top + extrude));
+			}
+
+			// colour conversion runs on the sprites as they're prepared, unless a mip chain has to be filtered first,
+			// single channel layers hold data rather than colour and are left alone
+			const px::ColorConverter converter(settings.premultiply, settings.transfer);
+			px::TextureContainer container;
+			const bool mipChain = settings.mipLevels > 1 && !settings.tileSize && px::textureContainerOf(path, container);
+
+			// the pages are the layers of one texture when they're all the same size
+			std::unique_ptr<px::TextureArrayWriter> array;
+			if (settings.textureArray && !settings.tileSize && px::textureContainerOf(path, container) && container == px::TextureContainer::KTX2
+				&& std::count(sizes.begin(), sizes.end(), sizes[0]) == static_cast<std::ptrdiff_t>(sizes.size()))
+				array.reset(new px::TextureArrayWriter(path, sizes[0], settings.format, settings.mipLevels, settings.filter, settings.compressionThreads, converter));
+
+			std::vector<size_t> pageOf(_images.size(), 0);
+			for (size_t i = 0; i < _images.size(); ++i)
+				if (_images[i]->getPage() < origins.size())
+					pageOf[i] = _images[i]->getPage();
+
+			// sprites are prepared when the first band they touch is reached and dropped after their last one,
+			// so only a band of the atlas and the sprites crossing it are held in memory
+			const unsigned int bandRows = 256, subBandRows = 16;
+			std::vector<std::vector<sf::Vector2i>> hulls(settings.emitPolygons ? _images.size() : 0);
+			std::vector<bool> prepared(_images.size(), false);
+			std::vector<px::Bitmap> sprites(_images.size());
+			const auto prepare = [&](const std::vector<size_t>& indices)
+			{
+				// the store isn't read in parallel here since scaling already spreads over all cores,
+				// nor does it keep the scaled copies, or they'd add up to the whole atlas by the last band
+				for (size_t k = 0; k < indices.size(); ++k)
+					sprites[indices[k]] = _images[indices[k]]->getBitmap(settings.filter, settings.linearScaling, false);
+
+				util::parallelFor(indices.size(), [&](const size_t k)
+				{
+					const size_t i = indices[k];
+					px::Bitmap& sprite = sprites[i];
+					if (settings.emitPolygons)
+						hulls[i] = px::findAlphaHull(sprite.pixels.data(), sprite.size, 0);
+					if (settings.bleedAlpha)
+						px::bleedAlpha(sprite.pixels.data(), sprite.size.x, sprite.size.y, sprite.stride());
+					if (extrude && sprite.size.x && sprite.size.y)
+					{
+						px::Bitmap padded(sprite.size + sf::Vector2u(2 * extrude, 2 * extrude));
+						px::extrude(sprite.pixels.data(), sprite.size.x, sprite.size.y, sprite.stride(), padded.pixels.data(), padded.stride(), extrude);
+						sprite = std::move(padded);
+					}
+					if (!mipChain && !converter.isIdentity() && _images[i]->getChannel() < 0)
+						converter.apply(sprite.pixels.data(), sprite.pixels.size() / 4);
+				});
+				for (size_t k = 0; k < indices.size(); ++k)
+					prepared[indices[k]] = true;
+			};
+
+			px::FormatSurvey survey;
+			for (size_t p = 0; p < origins.size(); ++p)
+			{
+				const sf::Vector2u pageSize = sizes[p];
+
+				// sprite rects in atlas pixels, known from the sizes alone
+				std::vector<size_t> members;
+				std::vector<sf::IntRect> placed;
+				for (size_t i = 0; i < _images.size(); ++i)
+				{
+					if (pageOf[i] != p)
+						continue;
+
+					sf::Vector2u size = _images[i]->getBitmapSize();
+					if (extrude && size.x && size.y)
+						size += sf::Vector2u(2 * extrude, 2 * extrude);
+					const sf::IntRect rect(
+						static_cast<int>(_images[i]->getPosition().x - origins[p].x) - extrude,
+						static_cast<int>(_images[i]->getPosition().y - origins[p].y) - extrude,
+						size.x, size.y);
+					sf::IntRect clipped;
+					if (rect.intersects(sf::IntRect(0, 0, pageSize.x, pageSize.y), clipped))
+					{
+						members.push_back(i);
+						placed.push_back(rect);
+					}
+				}
+
+				// mask packed sprites nest inside each other's bounds, those go through the alpha aware copy
+				std::vector<bool> overlapping(members.size(), false);
+				for (size_t a = 0; a < members.size(); ++a)
+					for (size_t b = a + 1; b < members.size(); ++b)
+						if (_images[members[a]]->getChannel() == _images[members[b]]->getChannel() && placed[a].intersects(placed[b]))
+							overlapping[a] = overlapping[b] = true;
+
+				std::vector<size_t> byTop(members.size());
+				for (size_t m = 0; m < byTop.size(); ++m)
+					byTop[m] = m;
+				std::stable_sort(byTop.begin(), byTop.end(), [&](const size_t a, const size_t b) { return placed[a].top < placed[b].top; });
+
+				const std::string pagePath = origins.size() > 1 && !array ? getPagePath(path, p) : path;
+				std::unique_ptr<px::ImageWriter> writer;
+				if (settings.tileSize)
+					writer.reset(new px::TileWriter(pagePath, pageSize, settings.tileSize, settings.tileBorder,
+						[&](const std::string& tilePath, const sf::Vector2u& tileSize)
+						{
+							return px::createImageWriter(tilePath, tileSize, settings.compressionLevel, 1, settings.format, settings.indexed, settings.dither, converter);
+						}, settings.compressionThreads));
+				else if (mipChain)
+				{
+					// sprite rects grown to the alignment the packer used for this many levels, each one owns whole texels all the way down
+					const int align = (px::isBlockCompressed(settings.format) ? 4 : 1) << (settings.mipLevels - 1);
+					std::vector<sf::IntRect> cells, colorCells;
+					for (size_t m = 0; m < placed.size(); ++m)
+					{
+						const int left = std::max(placed[m].left, 0) / align * align, top = std::max(placed[m].top, 0) / align * align;
+						const int right = (placed[m].left + placed[m].width + align - 1) / align * align, bottom = (placed[m].top + placed[m].height + align - 1) / align * align;
+						cells.push_back(sf::IntRect(left, top, right - left, bottom - top));
+						if (_images[members[m]]->getChannel() < 0)
+							colorCells.push_back(cells.back());
+					}
+					if (array)
+						writer = array->openLayer(cells, colorCells);
+					else
+						writer.reset(new px::MipChainWriter(pagePath, pageSize, container, settings.format, settings.mipLevels, cells, settings.filter, settings.compressionThreads,
+							converter, colorCells));
+				}
+				else if (array)
+					writer = array->openLayer();
+				else
+					writer = px::createImageWriter(pagePath, pageSize, settings.compressionLevel, settings.compressionThreads, settings.format, settings.indexed, settings.dither,
+						converter);
+				px::Bitmap band(sf::Vector2u(pageSize.x, std::min(bandRows, pageSize.y)));
+				px::PrecisionReducer reducer(settings.format, settings.dither, pageSize.x);
+				size_t next = 0;
+				for (unsigned int top = 0; top < pageSize.y; top += bandRows)
+				{
+					const unsigned int rows = std::min(bandRows, pageSize.y - top);
+
+					std::vector<size_t> entering;
+					for (; next < byTop.size() && placed[byTop[next]].top < static_cast<int>(top + rows); ++next)
+						entering.push_back(members[byTop[next]]);
+					prepare(entering);
 
-		ImageBox& operator[](std::size_t idx) { return *_images[idx]; }
-		const ImageBox& operator[](std::size_t idx) const { return *_images[idx]; }
+					// sub-bands are composed in parallel, sprite order within a row stays the same as a sequential copy
+					util::parallelFor((rows + subBandRows - 1) / subBandRows, [&](const size_t s)
+					{
+						const int first = static_cast<int>(top + s * subBandRows), last = std::min(first + static_cast<int>(subBandRows), static_cast<int>(top + rows));
+						std::memset(band.row(first - top), 0, (last - first) * band.stride());
+						for (size_t m = 0; m < members.size(); ++m)
+						{
+							const size_t i = members[m];
+							const sf::IntRect& rect = placed[m];
+							if (!prepared[i] || sprites[i].pixels.empty())
+								continue;
+
+							const int left = std::max(rect.left, 0), right = std::min(rect.left + rect.width, static_cast<int>(pageSize.x));
+							const int from = std::max(rect.top, first), to = std::min(rect.top + rect.height, last);
+							for (int y = from; y < to; ++y)
+							{
+								const sf::Uint8* src = sprites[i].row(y - rect.top) + (left - rect.left) * 4;
+								sf::Uint8* dst = band.row(y - top) + left * 4;
+								if (_images[i]->getChannel() >= 0)
+									px::composeChannelRow(src, dst, right - left, _images[i]->getChannel());
+								else if (overlapping[m])
+									px::composeRow(src, dst, right - left);
+								else
+									std::memcpy(dst, src, static_cast<size_t>(right - left) * 4);
+							}
+						}
+					});
 
-		bool exportToImage(const std::string& path, const bool createMapFile) const
-		{
-			if (_images.size() == 0)
-				return false;
+					survey.add(band.pixels.data(), static_cast<size_t>(rows) * pageSize.x);
+					reducer.apply(band.pixels.data(), rows);
+					if (!writer->writeRows(band.pixels.data(), rows))
+						return false;
 
-			const sf::IntRect bounds = getBounds();
-			if (bounds == sf::IntRect(0, 0, 0, 0))
+					for (size_t m = 0; m < members.size(); ++m)
+						if (placed[m].top + placed[m].height <= static_cast<int>(top + rows))
+							sprites[members[m]] = px::Bitmap();
+				}
+				if (!writer->finish())
+					return false;
+			}
+			if (array && !array->finish())
 				return false;
 
-			const sf::Vector2f offset(0.0 - bounds.left, 0.0 - bounds.top);
-			sf::Image result;
-			result.create(bounds.width + offset.x, bounds.height + offset.y, sf::Color(0, 0, 0, 0));
-			for (size_t i = 0; i < _images.size(); ++i)
-			{
-				sf::Image image(std::move(_images[i]->getImage()));
-				for (unsigned int y = 0; y < image.getSize().y; ++y)
-					for (unsigned int x = 0; x < image.getSize().x; ++x)
+			// sprites outside every page still get their outline in the map
+			if (settings.emitPolygons)
+				for (size_t i = 0; i < _images.size(); ++i)
+					if (!prepared[i])
 					{
-						result.setPixel(_images[i]->getPosition().x + offset.x + x, _images[i]->getPosition().y + offset.y + y, image.getPixel(x, y));
+						const px::Bitmap sprite = _images[i]->getBitmap(settings.filter, settings.linearScaling, false);
+						hulls[i] = px::findAlphaHull(sprite.pixels.data(), sprite.size, 0);
 					}
-			}
-			
-			if (!result.saveToFile(path))
-				return false;
 
-			if (createMapFile)
+			if (settings.createMapFile)
 			{
 				std::ofstream out(path.substr(0, path.rfind('.') + 1) + "atlm");
 
@@ -852,14 +4815,130 @@ namespace img
 				{
 					out
 						<< _images[i]->getNameTag() << ':'
-						<< _images[i]->getPosition().x + offset.x << ':'
-						<< _images[i]->getPosition().y + offset.y << ':'
+						<< _images[i]->getPosition().x - origins[pageOf[i]].x << ':'
+						<< _images[i]->getPosition().y - origins[pageOf[i]].y << ':'
 						<< static_cast<int>(_images[i]->getScaledSize().x) << ':'
-						<< static_cast<int>(_images[i]->getScaledSize().y) << '\n';
+						<< static_cast<int>(_images[i]->getScaledSize().y) << ':'
+						<< static_cast<int>(_images[i]->getUntrimmedSize().x) << ':'
+						<< static_cast<int>(_images[i]->getUntrimmedSize().y) << ':'
+						<< static_cast<int>(_images[i]->getTrimOffset().x) << ':'
+						<< static_cast<int>(_images[i]->getTrimOffset().y) << ':'
+						<< _images[i]->isRotated() << ':'
+						<< pageOf[i] << ':'
+						<< _images[i]->getGroup() << ':'
+						<< _images[i]->getChannel();
+
+					// polygon points are relative to the sprite's position in the atlas
+					if (settings.emitPolygons)
+					{
+						out << ':';
+						for (size_t p = 0; p < hulls[i].size(); ++p)
+							out << (p ? " " : "") << hulls[i][p].x << ',' << hulls[i][p].y;
+					}
+					out << '\n';
 				}
+
+				// drawing a group costs one texture bind (and at least one draw call) per page it touches
+				std::map<int, std::pair<size_t, std::set<size_t>>> groups;
+				for (size_t i = 0; i < _images.size(); ++i)
+					if (_images[i]->getGroup())
+					{
+						++groups[_images[i]->getGroup()].first;
+						groups[_images[i]->getGroup()].second.insert(pageOf[i]);
+					}
+				for (auto it = groups.begin(); it != groups.end(); ++it)
+					out << "#group:" << it->first << ':' << it->second.first << ':' << it->second.second.size() << '\n';
+
+				// smallest format that holds the composed pages exactly
+				out << "#suggested:" << px::formatName(survey.suggest()) << '\n';
+				// alpha and transfer of the stored colour, so the loader knows what's left to convert
+				out << "#color:" << (settings.premultiply ? "premultiplied" : "straight") << ':' << px::transferName(settings.transfer) << '\n';
+				// channel sets share these UVs, each one in atlas_<set>.png (and its pages)
+				for (size_t s = 0; s < settings.channelSets.size(); ++s)
+					out << "#set:" << settings.channelSets[s] << '\n';
+				// the page of every sprite is its layer in the array
+				if (array)
+					out << "#array:" << origins.size() << '\n';
+				// every page is a set of atlas_t<x>_<y> tiles found through its .ptab, each with a border on all sides
+				if (settings.tileSize)
+					out << "#tiles:" << settings.tileSize << ':' << settings.tileBorder << '\n';
+				// lower scale variants in atlas@<n>x.png, their coordinates are these divided by the divisor
+				for (unsigned int scale = settings.variantScale / 2; scale >= 1 && settings.variantScale > 1; scale /= 2)
+					out << "#variant:@" << scale << "x:" << settings.variantScale / scale << '\n';
 			}
 			return true;
 		}
+
+		// atlas.png -> atlas_2.png
+		static inline std::string getPagePath(const std::string& path, const size_t page) { return getSuffixedPath(path, '_' + std::to_string(page)); }
+		// atlas.png -> atlas_normal.png, atlas@2x.png
+		static std::string getSuffixedPath(const std::string& path, const std::string& suffix)
+		{
+			const size_t dot = path.rfind('.');
+			if (dot == std::string::npos || (path.rfind('\\') != std::string::npos && dot < path.rfind('\\')))
+				return path + suffix;
+			return path.substr(0, dot) + suffix + path.substr(dot);
+		}
+
+		// the layout at 1/divisor of its size, for the lower scale variants of an atlas packed at the highest one,
+		// the packer keeps positions and page sizes divisible by the divisor so every variant has the same UVs
+		std::unique_ptr<ImageVector> scaledCopy(const unsigned int divisor) const
+		{
+			const float d = static_cast<float>(divisor);
+			std::unique_ptr<ImageVector> result(new ImageVector(_position, _scale / d));
+			for (size_t p = 0; p < _pages.size(); ++p)
+				result->_pages.push_back(sf::IntRect(_pages[p].left / static_cast<int>(divisor), _pages[p].top / static_cast<int>(divisor),
+					_pages[p].width / static_cast<int>(divisor), _pages[p].height / static_cast<int>(divisor)));
+			for (size_t i = 0; i < _images.size(); ++i)
+			{
+				ImageBox* box = new ImageBox(_images[i]->getNameTag());
+				box->setPixels(_images[i]->getPixels());
+				box->setTrim(_images[i]->getTrim());
+				box->setScale(_images[i]->getScale() / d);
+				box->setRotated(_images[i]->isRotated());
+				box->setPosition(_position + (_images[i]->getPosition() - _position) / d);
+				box->setPage(_images[i]->getPage());
+				box->setGroup(_images[i]->getGroup());
+				box->setChannel(_images[i]->getChannel());
+				result->_images.push_back(box);
+			}
+			return result;
+		}
+
+		// the images laid out like their namesakes in layout, so every channel set of a material gets the same UVs,
+		// images of another resolution are scaled to cover the same rect and the ones layout doesn't have are left out
+		std::unique_ptr<ImageVector> withLayout(const ImageVector& layout) const
+		{
+			std::map<std::string, const ImageBox*> byName;
+			for (size_t i = 0; i < layout._images.size(); ++i)
+				byName[layout._images[i]->getNameTag()] = layout._images[i];
+
+			std::unique_ptr<ImageVector> result(new ImageVector(layout._position, layout._scale));
+			result->_pages = layout._pages;
+			for (size_t i = 0; i < _images.size(); ++i)
+			{
+				const auto it = byName.find(_images[i]->getNameTag());
+				if (it == byName.end())
+					continue;
+
+				const ImageBox& source = *it->second;
+				ImageBox* box = new ImageBox(_images[i]->getNameTag());
+				box->setPixels(_images[i]->getPixels());
+				const sf::Vector2f ratio(box->getSize().x / source.getSize().x, box->getSize().y / source.getSize().y);
+				const sf::IntRect trim = source.getTrim();
+				box->setTrim(sf::IntRect(
+					static_cast<int>(std::lround(trim.left * ratio.x)), static_cast<int>(std::lround(trim.top * ratio.y)),
+					static_cast<int>(std::lround(trim.width * ratio.x)), static_cast<int>(std::lround(trim.height * ratio.y))));
+				box->setScale(sf::Vector2f(source.getScale().x / ratio.x, source.getScale().y / ratio.y));
+				box->setRotated(source.isRotated());
+				box->setPosition(source.getPosition());
+				box->setPage(source.getPage());
+				box->setGroup(source.getGroup());
+				box->setChannel(source.getChannel());
+				result->_images.push_back(box);
+			}
+			return result;
+		}
 		void saveToFile(const std::string& path) const
 		{
 			CreateDirectoryA(path.c_str(), NULL);
@@ -871,6 +4950,28 @@ namespace img
 			std::string line;
 			while (getline(fileIn, line))
 			{
+				if (line.size() && line[0] == '#')
+				{
+					if (line.compare(0, 6, "#page:") == 0)
+					{
+						sf::IntRect page;
+						int* const field[] = { &page.left, &page.top, &page.width, &page.height };
+						size_t last = 5;
+						try
+						{
+							for (size_t i = 0; i < 4; ++i)
+							{
+								const size_t next = line.find(':', last + 1);
+								*field[i] = std::stoi(line.substr(last + 1, next));
+								last = next;
+							}
+							_pages.push_back(page);
+						}
+						catch (...)
+						{}
+					}
+					continue;
+				}
 				ImageBoxData data = ImageBox::deserialize(line);
 				if (data.isValid)
 				{
@@ -880,17 +4981,29 @@ namespace img
 			}
 		}
 
-		ImageVector& operator=(const ImageVector& other) 
+		ImageVector& operator=(ImageVector&& other) noexcept
 		{
+			if (this == &other)
+				return *this;
+
+			for (size_t i = 0; i < _images.size(); ++i)
+				delete _images[i];
 			_anySelected = other._anySelected;
-			_images = other._images;
+			_images = std::move(other._images);
+			_pages = std::move(other._pages);
+			_loading = std::move(other._loading);
+			_decoded = std::move(other._decoded);
 			_position = other._position;
 			_scale = other._scale;
+			other._images.clear();
+			other._loading.clear();
 			return *this;
 		}
 	};
 	std::ostream& operator<<(std::ostream& os, const ImageVector& obj)
 	{
+		for (size_t i = 0; i < obj.getPages().size(); ++i)
+			os << "#page:" << obj.getPages()[i].left << ':' << obj.getPages()[i].top << ':' << obj.getPages()[i].width << ':' << obj.getPages()[i].height << '\n';
 		for (size_t i = 0; i < obj.size(); ++i)
 			os << obj[i].serialize(obj.getScale()) << '\n';
 		return os;
@@ -899,48 +5012,329 @@ namespace img
 
 namespace pk
 {
+	class PackerSettings
+	{
+	public:
+		bool allowRotation, trimAlpha, maskPacking = false, linearScaling = false;
+		// single channel images (masks, AO, distance fields) share the pixels of the atlas, one per channel
+		bool channelPacking = false;
+		// every page as large as the largest one, so they can be the layers of a texture array
+		bool equalPages = false;
+		// pages only come in these sizes, chosen so all of them together take the least memory, empty for pages trimmed to their sprites
+		std::vector<rect_wh> pageSizes;
+		// sprites are scaled down until the pages take at most this many bytes in the export format, 0 for no limit,
+		// by one factor for the whole atlas, then each group raised back as far as the budget allows
+		sf::Uint64 memoryBudget = 0;
+		bool budgetPerGroup = false;
+		px::TextureFormat format = px::TextureFormat::RGBA8;
+		// levels written with each page, 1 unless the output is a .dds or .ktx2
+		unsigned int mipLevels = 1;
+		sf::Uint8 alphaThreshold;
+		unsigned int maskCellSize = 4, extrude = 0;
+		// rect sizes (and so positions) are rounded up to this, 4 keeps block compressed sprites in their own blocks
+		unsigned int blockAlign = 1;
+		// masks are built from the images scaled the same way export scales them
+		px::Filter filter = px::Filter::Lanczos3;
+		sf::Vector2i maxSize, margin;
+
+		PackerSettings(const sf::Vector2i& maxSize, const sf::Vector2i& margin, const bool allowRotation, const bool trimAlpha = false, const sf::Uint8 alphaThreshold = 0) :
+			allowRotation(allowRotation),
+			trimAlpha(trimAlpha),
+			alphaThreshold(alphaThreshold),
+			maxSize(maxSize),
+			margin(margin)
+		{}
+	};
+
 	class Rect : public rect_xywhf
 	{
 		img::ImageBox& const imgBox;
-		
+		sf::IntRect _trim;
+		px::BitMask _mask;
+		int _extrude;
+		size_t _page = 0;
+		bool _singleChannel = false;
+		int _channel = -1;
 
 	public:
-		Rect(img::ImageBox& imageBox, const sf::Vector2i& margin)
+		Rect(img::ImageBox& imageBox, const PackerSettings& settings)
 			:
-			imgBox(imageBox)
+			imgBox(imageBox),
+			_extrude(settings.extrude)
 		{
+			if (settings.trimAlpha)
+				_trim = imgBox.getOpaqueBounds(settings.alphaThreshold);
+			else
+				_trim = sf::IntRect(0, 0, imgBox.getSize().x, imgBox.getSize().y);
+
 			sf::FloatRect temp = imgBox.getBounds();
 			this->x = temp.left;
 			this->y = temp.top;
-			this->w = temp.width + margin.x;
-			this->h = temp.height + margin.y;
+			this->w = static_cast<int>(std::ceil(_trim.width * imgBox.getScale().x)) + settings.margin.x + 2 * _extrude;
+			this->h = static_cast<int>(std::ceil(_trim.height * imgBox.getScale().y)) + settings.margin.y + 2 * _extrude;
+			this->w = (this->w + settings.blockAlign - 1) / settings.blockAlign * settings.blockAlign;
+			this->h = (this->h + settings.blockAlign - 1) / settings.blockAlign * settings.blockAlign;
+			this->group = imgBox.getGroup();
+			_singleChannel = settings.channelPacking && imgBox.isSingleChannel();
+
+			// any visible pixel occupies its cell, export only skips fully transparent ones
+			if (settings.maskPacking)
+			{
+				px::Bitmap image(imgBox.getBitmap(_trim, settings.filter, settings.linearScaling));
+				if (_extrude && image.size.x && image.size.y)
+				{
+					px::Bitmap padded(image.size + sf::Vector2u(2 * _extrude, 2 * _extrude));
+					px::extrude(image.pixels.data(), image.size.x, image.size.y, image.stride(), padded.pixels.data(), padded.stride(), _extrude);
+					image = std::move(padded);
+				}
+				const unsigned int dilate = (std::max(settings.margin.x, settings.margin.y) + settings.maskCellSize - 1) / settings.maskCellSize;
+				_mask = px::buildAlphaMask(image.pixels.data(), image.size, settings.maskCellSize, 0, dilate);
+			}
 		}
 
-
+		inline const px::BitMask& getMask() const { return _mask; }
+		inline void setPage(const size_t page) { _page = page; }
+		inline size_t getPage() const { return _page; }
+		inline bool isSingleChannel() const { return _singleChannel; }
+		inline void setChannel(const int channel) { _channel = channel; }
 
 		void apply()
 		{
-			imgBox.setPosition(sf::Vector2f(this->x, this->y));
+			imgBox.setChannel(_channel);
+			imgBox.setTrim(_trim);
+			imgBox.setRotated(this->flipped);
+			imgBox.setPage(_page);
+			imgBox.setPosition(sf::Vector2f(this->x + _extrude, this->y + _extrude));
 		}
 	};
 
-	class PackerSettings
-	{
-	public:
-		bool allowRotation;
-		sf::Vector2i maxSize, margin;
-
-		PackerSettings(const sf::Vector2i& maxSize, const sf::Vector2i& margin, const bool allowRotation) :
-			allowRotation(allowRotation),
-			maxSize(maxSize),
-			margin(margin)
-		{}
-	};
-
 	class Packer
 	{
 		PackerSettings _settings;
 		std::vector<Rect> rects;
+		std::vector<sf::IntRect> _pages;
+
+		// bottom-left first fit of the alpha masks in an atlas of the given width (in cells), starting left pixels in
+		// every atlas row keeps its first free cell to start the search from, and rather than stepping by one the search
+		// jumps past the last occupied cell under the first run of set cells of the mask's longest run row,
+		// then of the row that overlaps
+		bool _placeMasks(const std::vector<Rect*>& order, const unsigned int width, const unsigned int maxHeight, const unsigned int left)
+		{
+			px::BitMask atlas(width, 0);
+			std::vector<unsigned int> firstFree, lead, run;
+
+			for (size_t i = 0; i < order.size(); ++i)
+			{
+				const px::BitMask& mask = order[i]->getMask();
+				lead.resize(mask.height());
+				run.resize(mask.height());
+				unsigned int key = 0;
+				for (unsigned int r = 0; r < mask.height(); ++r)
+				{
+					lead[r] = mask.nextSet(0, r);
+					run[r] = mask.nextClear(lead[r], r) - lead[r];
+					if (run[r] > run[key])
+						key = r;
+				}
+				// the last occupied cell under the run of row r with the mask at x, the end of the run when it's all free
+				const auto skip = [&](const unsigned int x, const unsigned int y, const unsigned int r)
+				{
+					const unsigned int start = x + lead[r], end = start + run[r], last = run[r] > 1 ? atlas.lastSet(start, end, y + r) : end;
+					return last < end ? last - lead[r] + 1 : x;
+				};
+
+				bool placed = false;
+				for (unsigned int y = 0; !placed && y + mask.height() <= maxHeight; ++y)
+				{
+					if (y + mask.height() > atlas.height())
+					{
+						atlas.addRows(y + mask.height() - atlas.height());
+						firstFree.resize(atlas.height(), 0);
+					}
+
+					// no row's first set cell can land left of the first free cell of its atlas row
+					unsigned int x = 0;
+					for (unsigned int r = 0; r < mask.height(); ++r)
+						if (lead[r] < mask.width() && lead[r] < firstFree[y + r])
+							x = std::max(x, firstFree[y + r] - lead[r]);
+
+					while (x + mask.width() <= width)
+					{
+						const unsigned int next = skip(x, y, key);
+						if (next != x)
+						{
+							x = next;
+							continue;
+						}
+						const unsigned int r = atlas.firstOverlap(mask, x, y);
+						if (r < mask.height())
+						{
+							x = std::max(x + 1, skip(x, y, r));
+							continue;
+						}
+						atlas.stamp(mask, x, y);
+						for (unsigned int r = 0; r < mask.height(); ++r)
+							firstFree[y + r] = atlas.nextClear(firstFree[y + r], y + r);
+						order[i]->x = left + x * _settings.maskCellSize;
+						order[i]->y = y * _settings.maskCellSize;
+						placed = true;
+						break;
+					}
+				}
+				if (!placed)
+					return false;
+			}
+			return true;
+		}
+		bool _packMasks(const std::vector<Rect*>& rects, const unsigned int left)
+		{
+			if (left > static_cast<unsigned int>(_settings.maxSize.x))
+				return rects.empty();
+			const unsigned int maxWidth = (_settings.maxSize.x - left) / _settings.maskCellSize;
+			const unsigned int maxHeight = _settings.maxSize.y / _settings.maskCellSize;
+
+			std::vector<Rect*> order;
+			size_t occupied = 0;
+			unsigned int widest = 1;
+			for (size_t i = 0; i < rects.size(); ++i)
+			{
+				const px::BitMask& mask = rects[i]->getMask();
+				if (mask.width() > maxWidth || mask.height() > maxHeight)
+					return false;
+				order.push_back(rects[i]);
+				occupied += mask.count();
+				widest = std::max(widest, mask.width());
+			}
+			std::sort(order.begin(), order.end(), [](const Rect* a, const Rect* b)
+			{
+				return a->getMask().width() * a->getMask().height() > b->getMask().width() * b->getMask().height();
+			});
+
+			// start from a square holding the occupied cells and double it until everything fits,
+			// then bisect back down to the narrowest width that still fits
+			unsigned int fails = 0, fits = 0;
+			for (unsigned int width = std::min(maxWidth, std::max(widest, static_cast<unsigned int>(std::ceil(std::sqrt(occupied * 1.1))))); !fits;
+				width = std::min(width * 2, maxWidth))
+			{
+				if (_placeMasks(order, width, maxHeight, left))
+					fits = width;
+				else if (width == maxWidth)
+					return false;
+				else
+					fails = width;
+			}
+			if (!fails)
+				return true;
+
+			bool placed = true;
+			while (fits - fails > 1)
+			{
+				const unsigned int width = fails + (fits - fails) / 2;
+				placed = _placeMasks(order, width, maxHeight, left);
+				if (placed)
+					fits = width;
+				else
+					fails = width;
+			}
+			// the rects hold the last attempt, so a failed one is placed again at the width that fit
+			return placed || _placeMasks(order, fits, maxHeight, left);
+		}
+
+		// single channel images are dealt to the four channel layers by area, largest first, so the layers fill up evenly
+		void _assignLayers(std::vector<Rect*>& colour, std::vector<std::vector<Rect*>>& layers)
+		{
+			layers.assign(4, std::vector<Rect*>());
+			std::vector<Rect*> single;
+			for (size_t i = 0; i < rects.size(); ++i)
+			{
+				rects[i].setChannel(-1);
+				if (rects[i].isSingleChannel())
+					single.push_back(&rects[i]);
+				else
+					colour.push_back(&rects[i]);
+			}
+			std::stable_sort(single.begin(), single.end(), [](const Rect* a, const Rect* b) { return a->w * a->h > b->w * b->h; });
+
+			size_t area[4] = { 0, 0, 0, 0 };
+			for (size_t i = 0; i < single.size(); ++i)
+			{
+				const int channel = static_cast<int>(std::min_element(area, area + 4) - area);
+				single[i]->setChannel(channel);
+				layers[channel].push_back(single[i]);
+				area[channel] += static_cast<size_t>(single[i]->w) * single[i]->h;
+			}
+		}
+
+		// every layer is packed into bins of its own and page i overlays bin i of each layer,
+		// pages that don't fit in one bin are laid out side by side, each one exported to its own file
+		bool _packPages(const std::vector<std::vector<Rect*>>& layers, int& pageLeft)
+		{
+			std::vector<std::vector<bin>> bins(layers.size());
+			size_t count = 0;
+			for (size_t l = 0; l < layers.size(); ++l)
+			{
+				if (layers[l].empty())
+					continue;
+
+				std::vector<rect_xywhf*> recPtr(layers[l].begin(), layers[l].end());
+				const bool packed = _settings.pageSizes.empty()
+					? pack(&recPtr[0], recPtr.size(), _settings.maxSize.x, _settings.maxSize.y, _settings.allowRotation, bins[l])
+					: pack(&recPtr[0], recPtr.size(), _settings.pageSizes, _settings.allowRotation, bins[l]);
+				if (!packed)
+					return false;
+				count = std::max(count, bins[l].size());
+			}
+
+			for (size_t i = 0; i < count; ++i)
+			{
+				sf::Vector2i size(0, 0);
+				for (size_t l = 0; l < layers.size(); ++l)
+					if (i < bins[l].size())
+						size = sf::Vector2i(std::max(size.x, bins[l][i].size.w), std::max(size.y, bins[l][i].size.h));
+
+				const size_t page = _pages.size();
+				_pages.push_back(sf::IntRect(pageLeft, 0, size.x, size.y));
+
+				for (size_t l = 0; l < layers.size(); ++l)
+					for (size_t r = 0; i < bins[l].size() && r < bins[l][i].rects.size(); ++r)
+					{
+						rect_xywhf* rect = bins[l][i].rects[r];
+						rect->x += pageLeft;
+						static_cast<Rect*>(rect)->setPage(page);
+					}
+				pageLeft += size.x + 20;
+			}
+			return true;
+		}
+
+		// pages grown to the largest one and laid out side by side again, the rects move with their page
+		void _equalizePages()
+		{
+			sf::Vector2i size(0, 0);
+			for (size_t p = 0; p < _pages.size(); ++p)
+				size = sf::Vector2i(std::max(size.x, _pages[p].width), std::max(size.y, _pages[p].height));
+
+			std::vector<int> shift(_pages.size());
+			int pageLeft = 0;
+			for (size_t p = 0; p < _pages.size(); ++p)
+			{
+				shift[p] = pageLeft - _pages[p].left;
+				_pages[p] = sf::IntRect(pageLeft, 0, size.x, size.y);
+				pageLeft += size.x + 20;
+			}
+			for (size_t i = 0; i < rects.size(); ++i)
+				if (rects[i].getPage() < shift.size())
+					rects[i].x += shift[rects[i].getPage()];
+		}
+
+		// video memory of the packed pages, mip levels only count when the container stores them
+		sf::Uint64 _layoutBytes() const
+		{
+			sf::Uint64 bytes = 0;
+			for (size_t p = 0; p < _pages.size(); ++p)
+				bytes += px::chainBytes(_settings.format, sf::Vector2u(_pages[p].width, _pages[p].height), _settings.mipLevels);
+			return bytes;
+		}
 
 	public:
 		Packer(const PackerSettings& settings) :
@@ -948,42 +5342,49 @@ namespace pk
 		{}
 
 		inline void changeSettings(const PackerSettings& settings) { _settings = settings; }
+		inline const std::vector<sf::IntRect>& getPages() const { return _pages; }
 
 		void loadRects(img::ImageVector& images)
 		{
 			rects.clear();
 
 			for (size_t i = 0; i < images.size(); ++i)
-				rects.emplace_back(Rect(images[i], _settings.margin));
+				rects.emplace_back(Rect(images[i], _settings));
 		}
 		bool packImages()
 		{
-			std::vector<rect_xywhf*> recPtr;
-
-			for (size_t i = 0; i < rects.size(); ++i)
-				recPtr.push_back(&rects[i]);
+			_pages.clear();
+			std::vector<Rect*> colour;
+			std::vector<std::vector<Rect*>> layers;
+			_assignLayers(colour, layers);
 
-			std::vector<bin> bins;
-
-			if (pack(&recPtr[0], recPtr.size(), _settings.maxSize.x, _settings.maxSize.y, _settings.allowRotation, bins)) 
+			if (_settings.maskPacking)
 			{
-				if (bins.size() != 1)
+				// the channel layers share the area right of the full colour sprites
+				if (!_packMasks(colour, 0))
 					return false;
-
-				for (int i = 0; i < bins.size(); ++i) {
-					printf("\n\nbin: %dx%d, rects: %d\n", bins[i].size.w, bins[i].size.h, bins[i].rects.size());
-
-					for (int r = 0; r < bins[i].rects.size(); ++r) {
-						rect_xywhf* rect = bins[i].rects[r];
-
-						printf("rect %d: x: %d, y: %d, w: %d, h: %d, was flipped: %s\n", r, rect->x, rect->y, rect->w, rect->h, rect->flipped ? "yes" : " no");
-					}
-				}
+				unsigned int left = 0;
+				for (size_t i = 0; i < colour.size(); ++i)
+					left = std::max(left, static_cast<unsigned int>(colour[i]->x + colour[i]->w));
+				left = (left + _settings.maskCellSize - 1) / _settings.maskCellSize * _settings.maskCellSize;
+				for (size_t l = 0; l < layers.size(); ++l)
+					if (!_packMasks(layers[l], left))
+						return false;
+
+				// the one page is the bounds of the packed rects, exported at exactly that size
+				sf::Vector2i size(0, 0);
+				for (size_t i = 0; i < rects.size(); ++i)
+					size = sf::Vector2i(std::max(size.x, rects[i].x + rects[i].w), std::max(size.y, rects[i].y + rects[i].h));
+				if (!rects.empty())
+					_pages.push_back(sf::IntRect(0, 0, size.x, size.y));
+				return true;
 			}
-			else
-			{
+
+			int pageLeft = 0;
+			if (!_packPages(std::vector<std::vector<Rect*>>(1, colour), pageLeft) || !_packPages(layers, pageLeft))
 				return false;
-			}
+			if (_settings.equalPages)
+				_equalizePages();
 			return true;
 		}
 		void applyChanges()
@@ -991,6 +5392,83 @@ namespace pk
 			for (size_t i = 0; i < rects.size(); ++i)
 				rects[i].apply();
 		}
+
+		// packs the images, with a memory budget set they're first scaled by the largest factor whose pages fit in it,
+		// found by bisection, and with budgetPerGroup each group (smallest first) then gets back as much of its scale as still fits
+		bool packWithinBudget(img::ImageVector& images)
+		{
+			if (!_settings.memoryBudget)
+			{
+				loadRects(images);
+				return packImages();
+			}
+
+			std::vector<sf::Vector2f> original(images.size());
+			std::map<int, float> area;
+			for (size_t i = 0; i < images.size(); ++i)
+			{
+				original[i] = images[i].getScale();
+				area[images[i].getGroup()] += images[i].getSize().x * std::abs(original[i].x) * images[i].getSize().y * std::abs(original[i].y);
+			}
+
+			std::map<int, float> factor;
+			for (auto it = area.begin(); it != area.end(); ++it)
+				factor[it->first] = 1.0f;
+			const auto fits = [&]()
+			{
+				for (size_t i = 0; i < images.size(); ++i)
+					images[i].setScale(original[i] * factor[images[i].getGroup()]);
+				loadRects(images);
+				return packImages() && _layoutBytes() <= _settings.memoryBudget;
+			};
+			// largest factor in [low, high] that fits, low is taken to fit already
+			const auto search = [&](const std::function<void(float)>& set, float low, float high)
+			{
+				for (int step = 0; step < 8; ++step)
+				{
+					const float middle = (low + high) / 2;
+					set(middle);
+					if (fits())
+						low = middle;
+					else
+						high = middle;
+				}
+				set(low);
+				return low;
+			};
+
+			if (!fits())
+			{
+				// a 64th of the size is as far as it goes, past that the sprites are no longer worth packing
+				const float smallest = 1.0f / 64;
+				for (auto it = factor.begin(); it != factor.end(); ++it)
+					it->second = smallest;
+				if (!fits())
+				{
+					for (size_t i = 0; i < images.size(); ++i)
+						images[i].setScale(original[i]);
+					return false;
+				}
+
+				const float global = search([&](const float f)
+				{
+					for (auto it = factor.begin(); it != factor.end(); ++it)
+						it->second = f;
+				}, smallest, 1.0f);
+
+				if (_settings.budgetPerGroup && factor.size() > 1)
+				{
+					std::vector<std::pair<float, int>> order;
+					for (auto it = area.begin(); it != area.end(); ++it)
+						order.push_back(std::make_pair(it->second, it->first));
+					std::sort(order.begin(), order.end());
+					for (size_t g = 0; g < order.size(); ++g)
+						search([&](const float f) { factor[order[g].second] = f; }, global, 1.0f);
+				}
+				fits();
+			}
+			return true;
+		}
 	};
 }
 
@@ -1141,6 +5619,8 @@ namespace ui
 
 		ADD_IMAGE,
 		DELETE_IMAGE,
+		GROUP_IMAGES,
+		UNGROUP_IMAGES,
 		DELETE_ALL,
 		SELECT_ALL,
 
@@ -1965,26 +6445,34 @@ namespace ui
 	};
 	class ImageOptionsMenu : public OptionsMenu
 	{
-		TextButton _deleteB;
+		TextButton _groupB, _ungroupB, _deleteB;
 
 
 	public:
 		ImageOptionsMenu() :
 			OptionsMenu(),
-			_deleteB(sf::Vector2f(100.0, 24.0), sf::Vector2f(0.0, 0.0), 14, "Delete", ActionEvent::NONE, Defined::DefaultFont, TextAlignment::Center, false, Defined::RedDarkGrey)
+			_groupB(sf::Vector2f(100.0, 24.0), sf::Vector2f(0.0, 0.0), 14, "Group", ActionEvent::NONE, Defined::DefaultFont, TextAlignment::Center, false, Defined::Grey),
+			_ungroupB(sf::Vector2f(100.0, 24.0), Button::below(_groupB), 14, "Ungroup", ActionEvent::NONE, Defined::DefaultFont, TextAlignment::Center, false, Defined::Grey),
+			_deleteB(sf::Vector2f(100.0, 24.0), Button::below(_ungroupB), 14, "Delete", ActionEvent::NONE, Defined::DefaultFont, TextAlignment::Center, false, Defined::RedDarkGrey)
 		{}
 
 		void setPosition(const sf::Vector2f& position) override
 		{
 			_back.setPosition(position);
-			_deleteB.setPosition(position);
+			_groupB.setPosition(position);
+			_ungroupB.setPosition(Button::below(_groupB));
+			_deleteB.setPosition(Button::below(_ungroupB));
 		}
 
 		ActionResult<> handleEvent(const sf::Event& event, const sf::Vector2f& mousePosition)
 		{
 			if (event.type == sf::Event::MouseButtonPressed)
 			{
-				if (_deleteB.contains(mousePosition))
+				if (_groupB.contains(mousePosition))
+					return ActionEvent::GROUP_IMAGES;
+				else if (_ungroupB.contains(mousePosition))
+					return ActionEvent::UNGROUP_IMAGES;
+				else if (_deleteB.contains(mousePosition))
 					return ActionEvent::DELETE_IMAGE;
 			}
 			return ActionEvent::NONE;
@@ -1993,6 +6481,8 @@ namespace ui
 		void draw(sf::RenderWindow& window, const sf::Vector2f& point)
 		{
 			_back.draw(window);
+			_groupB.draw(window, point);
+			_ungroupB.draw(window, point);
 			_deleteB.draw(window, point);
 		}
 	};
@@ -2098,24 +6588,124 @@ namespace ui
 	{
 		bool _isOpen = false;
 		Background _back;
-		TextBox _packerSettings, _dimensions, _maxWidth, _maxHeight, _margins, _xMargin, _yMargin;
-		IntegerInputBox _maxWidthV, _maxHeightV, _xMarginV, _yMarginV;
+		TextBox _packerSettings, _dimensions, _maxWidth, _maxHeight, _margins, _xMargin, _yMargin, _trimming, _trimAlpha, _alphaThreshold,
+			_tightPacking, _maskPacking, _maskCellSize, _channelPacking, _sharedLayout, _variants, _textureArray, _budget, _budgetPerGroup, _pageSizes, _rotation,
+			_exportSettings, _mapFile, _polygons, _edges, _extrude, _bleedAlpha, _scaling, _filter, _linearScaling, _compression, _level, _threads, _blocks, _format, _mips, _dither, _indexed, _premultiply, _transfer, _tiles, _container;
+		IntegerInputBox _maxWidthV, _maxHeightV, _xMarginV, _yMarginV, _alphaThresholdV, _maskCellSizeV, _extrudeV, _filterV, _levelV, _threadsV, _formatV, _mipsV, _ditherV, _transferV, _variantsV, _tilesV, _budgetV, _containerV;
+		TickBox _trimAlphaTB, _maskPackingTB, _channelPackingTB, _sharedLayoutTB, _textureArrayTB, _budgetPerGroupTB, _pageSizesTB, _rotationTB, _polygonsTB, _bleedAlphaTB, _linearScalingTB, _indexedTB, _premultiplyTB;
 		sf::Clock _clock;
 
+		inline std::vector<TextBox*> _labels()
+		{
+			return { &_packerSettings, &_dimensions, &_maxWidth, &_maxHeight, &_margins, &_xMargin, &_yMargin, &_trimming, &_trimAlpha, &_alphaThreshold,
+				&_tightPacking, &_maskPacking, &_maskCellSize, &_channelPacking, &_sharedLayout, &_variants, &_textureArray, &_budget, &_budgetPerGroup, &_pageSizes, &_rotation,
+				&_exportSettings, &_mapFile, &_polygons, &_edges, &_extrude, &_bleedAlpha, &_scaling, &_filter, &_linearScaling, &_compression, &_level, &_threads, &_blocks, &_format, &_mips, &_dither, &_indexed, &_premultiply, &_transfer, &_tiles, &_container };
+		}
+		inline std::vector<IntegerInputBox*> _inputs()
+		{
+			return { &_maxWidthV, &_maxHeightV, &_xMarginV, &_yMarginV, &_alphaThresholdV, &_maskCellSizeV, &_extrudeV, &_filterV, &_levelV, &_threadsV, &_formatV, &_mipsV, &_ditherV, &_transferV, &_variantsV, &_tilesV, &_budgetV, &_containerV };
+		}
+		inline std::vector<TickBox*> _tickBoxes()
+		{
+			return { &_trimAlphaTB, &_maskPackingTB, &_channelPackingTB, &_sharedLayoutTB, &_textureArrayTB, &_budgetPerGroupTB, &_pageSizesTB, &_rotationTB, &_polygonsTB, &_bleedAlphaTB, &_linearScalingTB, &_indexedTB, &_premultiplyTB };
+		}
+
+		// 3 rounds down to 2, variants halve the scale each time
+		inline unsigned int _variantScale() { return _variantsV.getValue() >= 4 ? 4 : _variantsV.getValue() >= 2 ? 2 : 1; }
+		// rounded up to the variant scale like the margin and alignment, so the ring is whole pixels in every variant
+		inline unsigned int _extrudeSize() { return (_extrudeV.getValue() + _variantScale() - 1) / _variantScale() * _variantScale(); }
+
+		// only .dds and .ktx2 hold a mip chain, and it stops before its alignment would outgrow the smaller side of the atlas,
+		// mask packing nests sprites in each other's cells, which can't be scaled down apart, so it keeps level 0 only
+		unsigned int _mipLevels()
+		{
+			if (!_containerV.getValue() || _maskPackingTB.isTicked())
+				return 1;
+
+			const int side = std::min(_maxWidthV.getValue(), _maxHeightV.getValue());
+			const int block = (px::isBlockCompressed(static_cast<px::TextureFormat>(_formatV.getValue())) ? 4 : 1) * static_cast<int>(_variantScale());
+			unsigned int levels = 1;
+			while (levels < static_cast<unsigned int>(_mipsV.getValue()) && levels < 31 && (static_cast<long long>(block) << levels) <= side)
+				++levels;
+			return levels;
+		}
+
 	public:
 		SettingsMenu(const sf::Vector2f& position) :
-			_back(sf::Vector2f(400.0, 400.0), position, Defined::Grey),
+			_back(sf::Vector2f(640.0, 530.0), position, Defined::Grey),
 			_packerSettings(position + sf::Vector2f(10.0, 10.0), 16, "Packer Settings"),
 			_dimensions(TextBox::below(_packerSettings) + sf::Vector2f(10.0, 10.0), 14, "Maximum atlas size (in pixels)"),
+			_rotation(TextBox::after(_packerSettings) + sf::Vector2f(120.0, 2.0), 14, "Allow rotation:", Defined::DefaultFont, Defined::LightGrey),
 			_maxWidth(TextBox::below(_dimensions) + sf::Vector2f(10.0, 12.0), 14, "Max Width:", Defined::DefaultFont, Defined::LightGrey),
 			_maxHeight(TextBox::after(_maxWidth) + sf::Vector2f(80.0, 0.0), 14, "Max Height:", Defined::DefaultFont, Defined::LightGrey),
 			_margins(TextBox::below(_maxWidth) + sf::Vector2f(-10.0, 20.0), 14, "Image margins (in pixels)"),
 			_xMargin(TextBox::below(_margins) + sf::Vector2f(10.0, 12.0), 14, "X-Margin:", Defined::DefaultFont, Defined::LightGrey),
 			_yMargin(TextBox::after(_xMargin) + sf::Vector2f(80.0, 0.0), 14, "Y-Margin:", Defined::DefaultFont, Defined::LightGrey),
+			_trimming(TextBox::below(_xMargin) + sf::Vector2f(-10.0, 20.0), 14, "Transparent borders"),
+			_trimAlpha(TextBox::below(_trimming) + sf::Vector2f(10.0, 12.0), 14, "Trim:", Defined::DefaultFont, Defined::LightGrey),
+			_alphaThreshold(TextBox::after(_trimAlpha) + sf::Vector2f(80.0, 0.0), 14, "Alpha threshold:", Defined::DefaultFont, Defined::LightGrey),
+			_tightPacking(TextBox::below(_trimAlpha) + sf::Vector2f(-10.0, 20.0), 14, "Tight packing of irregular images"),
+			_maskPacking(TextBox::below(_tightPacking) + sf::Vector2f(10.0, 12.0), 14, "Alpha masks:", Defined::DefaultFont, Defined::LightGrey),
+			_maskCellSize(TextBox::after(_maskPacking) + sf::Vector2f(60.0, 0.0), 14, "Cell size:", Defined::DefaultFont, Defined::LightGrey),
+			_channelPacking(TextBox::below(_maskPacking) + sf::Vector2f(0.0, 20.0), 14, "Single channel images per channel:", Defined::DefaultFont, Defined::LightGrey),
+			_sharedLayout(TextBox::below(_channelPacking) + sf::Vector2f(0.0, 20.0), 14, "Export other tabs with this layout:", Defined::DefaultFont, Defined::LightGrey),
+			_variants(TextBox::below(_sharedLayout) + sf::Vector2f(0.0, 20.0), 14, "Scale variants (1, 2 or 4):", Defined::DefaultFont, Defined::LightGrey),
+			_textureArray(TextBox::below(_variants) + sf::Vector2f(0.0, 20.0), 14, "Pages as a KTX2 texture array:", Defined::DefaultFont, Defined::LightGrey),
+			_budget(TextBox::below(_textureArray) + sf::Vector2f(0.0, 20.0), 14, "Memory budget (MiB, 0 = off):", Defined::DefaultFont, Defined::LightGrey),
+			_budgetPerGroup(TextBox::below(_budget) + sf::Vector2f(0.0, 20.0), 14, "Scale groups separately:", Defined::DefaultFont, Defined::LightGrey),
+			_pageSizes(TextBox::below(_budgetPerGroup) + sf::Vector2f(0.0, 20.0), 14, "Power of two page sizes:", Defined::DefaultFont, Defined::LightGrey),
+			_exportSettings(position + sf::Vector2f(400.0, 10.0), 16, "Export Settings"),
+			_mapFile(TextBox::below(_exportSettings) + sf::Vector2f(10.0, 10.0), 14, "Map file"),
+			_polygons(TextBox::below(_mapFile) + sf::Vector2f(10.0, 12.0), 14, "Polygons:", Defined::DefaultFont, Defined::LightGrey),
+			_edges(TextBox::below(_polygons) + sf::Vector2f(-10.0, 20.0), 14, "Sprite edges (in pixels)"),
+			_extrude(TextBox::below(_edges) + sf::Vector2f(10.0, 12.0), 14, "Extrude:", Defined::DefaultFont, Defined::LightGrey),
+			_bleedAlpha(TextBox::after(_extrude) + sf::Vector2f(60.0, 0.0), 14, "Bleed:", Defined::DefaultFont, Defined::LightGrey),
+			_scaling(TextBox::below(_extrude) + sf::Vector2f(-10.0, 20.0), 14, "Scaling (box, bilinear, lanczos)"),
+			_filter(TextBox::below(_scaling) + sf::Vector2f(10.0, 12.0), 14, "Filter:", Defined::DefaultFont, Defined::LightGrey),
+			_linearScaling(TextBox::after(_filter) + sf::Vector2f(60.0, 0.0), 14, "sRGB:", Defined::DefaultFont, Defined::LightGrey),
+			_compression(TextBox::below(_filter) + sf::Vector2f(-10.0, 20.0), 14, "PNG compression (0 = all threads)"),
+			_level(TextBox::below(_compression) + sf::Vector2f(10.0, 12.0), 14, "Level:", Defined::DefaultFont, Defined::LightGrey),
+			_threads(TextBox::after(_level) + sf::Vector2f(60.0, 0.0), 14, "Threads:", Defined::DefaultFont, Defined::LightGrey),
+			_blocks(TextBox::below(_level) + sf::Vector2f(-10.0, 20.0), 14, "Output format: rgba8"),
+			_format(TextBox::below(_blocks) + sf::Vector2f(10.0, 12.0), 14, "Format:", Defined::DefaultFont, Defined::LightGrey),
+			_mips(TextBox::after(_format) + sf::Vector2f(60.0, 0.0), 14, "Mip levels:", Defined::DefaultFont, Defined::LightGrey),
+			_dither(TextBox::below(_format) + sf::Vector2f(0.0, 20.0), 14, "Dither (off, ordered, diffusion):", Defined::DefaultFont, Defined::LightGrey),
+			_indexed(TextBox::below(_dither) + sf::Vector2f(0.0, 20.0), 14, "Palette PNG:", Defined::DefaultFont, Defined::LightGrey),
+			_premultiply(TextBox::after(_indexed) + sf::Vector2f(60.0, 0.0), 14, "Premultiply:", Defined::DefaultFont, Defined::LightGrey),
+			_transfer(TextBox::below(_indexed) + sf::Vector2f(0.0, 20.0), 14, "Colour (keep, to linear, to sRGB):", Defined::DefaultFont, Defined::LightGrey),
+			_tiles(TextBox::below(_transfer) + sf::Vector2f(0.0, 20.0), 14, "Virtual texture tiles (0 = off):", Defined::DefaultFont, Defined::LightGrey),
+			_container(TextBox::below(_tiles) + sf::Vector2f(0.0, 20.0), 14, "Container (image, dds, ktx2):", Defined::DefaultFont, Defined::LightGrey),
 			_maxWidthV(sf::Vector2f(64.0, 34.0), TextBox::after(_maxWidth) + sf::Vector2f(0.0, -10.0), 14, 0, 65536, 65536, ActionEvent::NONE, Defined::DefaultFont, Defined::Grey),
 			_maxHeightV(sf::Vector2f(64.0, 34.0), TextBox::after(_maxHeight) + sf::Vector2f(0.0, -10.0), 14, 0, 65536, 65536, ActionEvent::NONE, Defined::DefaultFont, Defined::Grey),
 			_xMarginV(sf::Vector2f(36.0, 34.0), TextBox::after(_xMargin) + sf::Vector2f(0.0, -10.0), 14, 0, 32, 0, ActionEvent::NONE, Defined::DefaultFont, Defined::Grey),
-			_yMarginV(sf::Vector2f(36.0, 34.0), TextBox::after(_yMargin) + sf::Vector2f(0.0, -10.0), 14, 0, 32, 0, ActionEvent::NONE, Defined::DefaultFont, Defined::Grey)
+			_yMarginV(sf::Vector2f(36.0, 34.0), TextBox::after(_yMargin) + sf::Vector2f(0.0, -10.0), 14, 0, 32, 0, ActionEvent::NONE, Defined::DefaultFont, Defined::Grey),
+			_alphaThresholdV(sf::Vector2f(44.0, 34.0), TextBox::after(_alphaThreshold) + sf::Vector2f(0.0, -10.0), 14, 0, 254, 0, ActionEvent::NONE, Defined::DefaultFont, Defined::Grey),
+			_maskCellSizeV(sf::Vector2f(36.0, 34.0), TextBox::after(_maskCellSize) + sf::Vector2f(0.0, -10.0), 14, 1, 64, 4, ActionEvent::NONE, Defined::DefaultFont, Defined::Grey),
+			_extrudeV(sf::Vector2f(36.0, 34.0), TextBox::after(_extrude) + sf::Vector2f(0.0, -10.0), 14, 0, 32, 0, ActionEvent::NONE, Defined::DefaultFont, Defined::Grey),
+			_filterV(sf::Vector2f(36.0, 34.0), TextBox::after(_filter) + sf::Vector2f(0.0, -10.0), 14, 0, 2, 2, ActionEvent::NONE, Defined::DefaultFont, Defined::Grey),
+			_levelV(sf::Vector2f(36.0, 34.0), TextBox::after(_level) + sf::Vector2f(0.0, -10.0), 14, 0, 9, 6, ActionEvent::NONE, Defined::DefaultFont, Defined::Grey),
+			_threadsV(sf::Vector2f(36.0, 34.0), TextBox::after(_threads) + sf::Vector2f(0.0, -10.0), 14, 0, 64, 0, ActionEvent::NONE, Defined::DefaultFont, Defined::Grey),
+			_formatV(sf::Vector2f(36.0, 34.0), TextBox::after(_format) + sf::Vector2f(0.0, -10.0), 14, 0, 9, 0, ActionEvent::NONE, Defined::DefaultFont, Defined::Grey),
+			_mipsV(sf::Vector2f(36.0, 34.0), TextBox::after(_mips) + sf::Vector2f(0.0, -10.0), 14, 1, 16, 1, ActionEvent::NONE, Defined::DefaultFont, Defined::Grey),
+			_ditherV(sf::Vector2f(36.0, 34.0), TextBox::after(_dither) + sf::Vector2f(0.0, -10.0), 14, 0, 2, 0, ActionEvent::NONE, Defined::DefaultFont, Defined::Grey),
+			_transferV(sf::Vector2f(36.0, 34.0), TextBox::after(_transfer) + sf::Vector2f(0.0, -10.0), 14, 0, 2, 0, ActionEvent::NONE, Defined::DefaultFont, Defined::Grey),
+			_variantsV(sf::Vector2f(36.0, 34.0), TextBox::after(_variants) + sf::Vector2f(0.0, -10.0), 14, 1, 4, 1, ActionEvent::NONE, Defined::DefaultFont, Defined::Grey),
+			_tilesV(sf::Vector2f(52.0, 34.0), TextBox::after(_tiles) + sf::Vector2f(0.0, -10.0), 14, 0, 4096, 0, ActionEvent::NONE, Defined::DefaultFont, Defined::Grey),
+			_budgetV(sf::Vector2f(52.0, 34.0), TextBox::after(_budget) + sf::Vector2f(0.0, -10.0), 14, 0, 4096, 0, ActionEvent::NONE, Defined::DefaultFont, Defined::Grey),
+			_containerV(sf::Vector2f(36.0, 34.0), TextBox::after(_container) + sf::Vector2f(0.0, -10.0), 14, 0, 2, 0, ActionEvent::NONE, Defined::DefaultFont, Defined::Grey),
+			_trimAlphaTB(sf::Vector2f(18.0, 18.0), TextBox::after(_trimAlpha) + sf::Vector2f(6.0, -1.0), ActionEvent::NONE, false, Defined::MediumLightGrey),
+			_maskPackingTB(sf::Vector2f(18.0, 18.0), TextBox::after(_maskPacking) + sf::Vector2f(6.0, -1.0), ActionEvent::NONE, false, Defined::MediumLightGrey),
+			_channelPackingTB(sf::Vector2f(18.0, 18.0), TextBox::after(_channelPacking) + sf::Vector2f(6.0, -1.0), ActionEvent::NONE, false, Defined::MediumLightGrey),
+			_sharedLayoutTB(sf::Vector2f(18.0, 18.0), TextBox::after(_sharedLayout) + sf::Vector2f(6.0, -1.0), ActionEvent::NONE, false, Defined::MediumLightGrey),
+			_textureArrayTB(sf::Vector2f(18.0, 18.0), TextBox::after(_textureArray) + sf::Vector2f(6.0, -1.0), ActionEvent::NONE, false, Defined::MediumLightGrey),
+			_budgetPerGroupTB(sf::Vector2f(18.0, 18.0), TextBox::after(_budgetPerGroup) + sf::Vector2f(6.0, -1.0), ActionEvent::NONE, false, Defined::MediumLightGrey),
+			_pageSizesTB(sf::Vector2f(18.0, 18.0), TextBox::after(_pageSizes) + sf::Vector2f(6.0, -1.0), ActionEvent::NONE, false, Defined::MediumLightGrey),
+			_rotationTB(sf::Vector2f(18.0, 18.0), TextBox::after(_rotation) + sf::Vector2f(6.0, -1.0), ActionEvent::NONE, false, Defined::MediumLightGrey),
+			_polygonsTB(sf::Vector2f(18.0, 18.0), TextBox::after(_polygons) + sf::Vector2f(6.0, -1.0), ActionEvent::NONE, false, Defined::MediumLightGrey),
+			_bleedAlphaTB(sf::Vector2f(18.0, 18.0), TextBox::after(_bleedAlpha) + sf::Vector2f(6.0, -1.0), ActionEvent::NONE, false, Defined::MediumLightGrey),
+			_linearScalingTB(sf::Vector2f(18.0, 18.0), TextBox::after(_linearScaling) + sf::Vector2f(6.0, -1.0), ActionEvent::NONE, false, Defined::MediumLightGrey),
+			_indexedTB(sf::Vector2f(18.0, 18.0), TextBox::after(_indexed) + sf::Vector2f(6.0, -1.0), ActionEvent::NONE, false, Defined::MediumLightGrey),
+			_premultiplyTB(sf::Vector2f(18.0, 18.0), TextBox::after(_premultiply) + sf::Vector2f(6.0, -1.0), ActionEvent::NONE, false, Defined::MediumLightGrey)
 		{}
 
 		inline void open() { _isOpen = true; }
@@ -2123,71 +6713,117 @@ namespace ui
 		{ 
 			_isOpen = false;
 
-			return pk::PackerSettings(
+			pk::PackerSettings settings(
 				sf::Vector2i(_maxWidthV.getValue(), _maxHeightV.getValue()),
 				sf::Vector2i(_xMarginV.getValue(), _xMarginV.getValue()),
-				false);
+				_rotationTB.isTicked(),
+				_trimAlphaTB.isTicked(),
+				static_cast<sf::Uint8>(_alphaThresholdV.getValue()));
+			settings.maskPacking = _maskPackingTB.isTicked();
+			settings.channelPacking = _channelPackingTB.isTicked();
+			settings.equalPages = _textureArrayTB.isTicked();
+			settings.memoryBudget = static_cast<sf::Uint64>(_budgetV.getValue()) << 20;
+			settings.budgetPerGroup = _budgetPerGroupTB.isTicked();
+			// the largest power of two within the maximum size and the three below it
+			if (_pageSizesTB.isTicked())
+			{
+				int width = 1, height = 1;
+				while (width * 2 <= settings.maxSize.x)
+					width *= 2;
+				while (height * 2 <= settings.maxSize.y)
+					height *= 2;
+				for (int k = 0; k < 4 && (width >> k) >= 16 && (height >> k) >= 16; ++k)
+					settings.pageSizes.push_back(rect_wh(width >> k, height >> k));
+			}
+			settings.format = static_cast<px::TextureFormat>(_formatV.getValue());
+			settings.mipLevels = _mipLevels();
+			settings.maskCellSize = _maskCellSizeV.getValue();
+			settings.extrude = _extrudeSize();
+			settings.filter = static_cast<px::Filter>(_filterV.getValue());
+			settings.linearScaling = _linearScalingTB.isTicked();
+			// block compression needs every rect, and every mask cell, to cover whole 4x4 blocks, at every mip level
+			// that's kept and in every scale variant, and the margin leaves at least a texel between sprites at the smallest
+			// levels past what the atlas can align to are dropped, and the box shows how many are kept
+			const unsigned int levels = _mipLevels();
+			if (_containerV.getValue() && levels < static_cast<unsigned int>(_mipsV.getValue()))
+				_mipsV.insertString(std::to_string(levels));
+			const unsigned int reduction = (1u << (levels - 1)) * _variantScale();
+			settings.blockAlign = (px::isBlockCompressed(static_cast<px::TextureFormat>(_formatV.getValue())) ? 4 : 1) * reduction;
+			settings.maskCellSize = (settings.maskCellSize + settings.blockAlign - 1) / settings.blockAlign * settings.blockAlign;
+			if (reduction > 1)
+				settings.margin = sf::Vector2i(std::max(settings.margin.x, static_cast<int>(reduction)), std::max(settings.margin.y, static_cast<int>(reduction)));
+			return settings;
 		}
 		inline bool isOpen() const { return _isOpen; }
 
+		// the name picked in the save dialog, with the extension of the chosen texture container
+		std::string getExportPath(const std::string& path) const
+		{
+			static const char* const extensions[] = { "", ".dds", ".ktx2" };
+			const int container = _containerV.getValue();
+			if (!container)
+				return path;
+
+			const size_t dot = path.rfind('.'), slash = path.find_last_of("\\/");
+			const bool extension = dot != std::string::npos && (slash == std::string::npos || dot > slash);
+			return (extension ? path.substr(0, dot) : path) + extensions[container];
+		}
+
+		img::ExportSettings getExportSettings()
+		{
+			img::ExportSettings settings(true, _polygonsTB.isTicked());
+			settings.extrude = _extrudeSize();
+			settings.bleedAlpha = _bleedAlphaTB.isTicked();
+			settings.filter = static_cast<px::Filter>(_filterV.getValue());
+			settings.linearScaling = _linearScalingTB.isTicked();
+			settings.compressionLevel = _levelV.getValue();
+			settings.compressionThreads = _threadsV.getValue();
+			settings.format = static_cast<px::TextureFormat>(_formatV.getValue());
+			settings.mipLevels = _mipLevels();
+			settings.dither = static_cast<px::Dither>(_ditherV.getValue());
+			settings.indexed = _indexedTB.isTicked();
+			settings.premultiply = _premultiplyTB.isTicked();
+			settings.transfer = static_cast<px::Transfer>(_transferV.getValue());
+			settings.sharedLayout = _sharedLayoutTB.isTicked();
+			settings.variantScale = _variantScale();
+			settings.textureArray = _textureArrayTB.isTicked();
+			settings.tileSize = _tilesV.getValue();
+			return settings;
+		}
+
 		ActionResult<> handleEvent(const sf::Event& event, const sf::Vector2f& mousePosition)
 		{
+			const std::vector<IntegerInputBox*> inputs = _inputs();
+			IntegerInputBox* selected = nullptr;
+			for (size_t i = 0; i < inputs.size() && !selected; ++i)
+				if (inputs[i]->isSelected())
+					selected = inputs[i];
+
 			if (event.type == sf::Event::MouseButtonPressed)
 			{
-				_maxWidthV.setSelected(_maxWidthV.contains(mousePosition));
-				_maxHeightV.setSelected(_maxHeightV.contains(mousePosition));
-				_xMarginV.setSelected(_xMarginV.contains(mousePosition));
-				_yMarginV.setSelected(_yMarginV.contains(mousePosition));
+				for (size_t i = 0; i < inputs.size(); ++i)
+					inputs[i]->setSelected(inputs[i]->contains(mousePosition));
+
+				const std::vector<TickBox*> tickBoxes = _tickBoxes();
+				for (size_t i = 0; i < tickBoxes.size(); ++i)
+					if (tickBoxes[i]->contains(mousePosition))
+						tickBoxes[i]->tick();
 
 				if (_back.contains(mousePosition))
 					return ActionEvent::KEEP_OPEN;
 			}
-			else if (event.type == sf::Event::KeyPressed)
+			else if (event.type == sf::Event::KeyPressed && selected)
 			{
 				if (event.key.code == sf::Keyboard::Left)
-				{
-					if (_maxWidthV.isSelected())
-						_maxWidthV.moveCursor(-1);
-					else if(_maxHeightV.isSelected())
-						_maxHeightV.moveCursor(-1);
-					else if (_xMarginV.isSelected())
-						_xMarginV.moveCursor(-1);
-					else if (_yMarginV.isSelected())
-						_yMarginV.moveCursor(-1);
-				}
+					selected->moveCursor(-1);
 				else if (event.key.code == sf::Keyboard::Right)
-				{
-					if (_maxWidthV.isSelected())
-						_maxWidthV.moveCursor(1);
-					else if (_maxHeightV.isSelected())
-						_maxHeightV.moveCursor(1);
-					else if (_xMarginV.isSelected())
-						_xMarginV.moveCursor(1);
-					else if (_yMarginV.isSelected())
-						_yMarginV.moveCursor(1);
-				}
+					selected->moveCursor(1);
 				else if (sf::Keyboard::isKeyPressed(sf::Keyboard::LControl) && sf::Keyboard::isKeyPressed(sf::Keyboard::V))
-				{
-					if (_maxWidthV.isSelected())
-						_maxWidthV.insertString(os::SystemData::getFromClipboard());
-					else if (_maxHeightV.isSelected())
-						_maxHeightV.insertString(os::SystemData::getFromClipboard());
-					else if (_xMarginV.isSelected())
-						_xMarginV.insertString(os::SystemData::getFromClipboard());
-					else if (_yMarginV.isSelected())
-						_yMarginV.insertString(os::SystemData::getFromClipboard());
-				}
+					selected->insertString(os::SystemData::getFromClipboard());
 			}
-			else if (event.type == sf::Event::TextEntered)
+			else if (event.type == sf::Event::TextEntered && selected)
 			{
-				if (_maxWidthV.isSelected())
-					_maxWidthV.modifyString(event.text.unicode);
-				else if (_maxHeightV.isSelected())
-					_maxHeightV.modifyString(event.text.unicode);
-				else if (_xMarginV.isSelected())
-					_xMarginV.modifyString(event.text.unicode);
-				else if (_yMarginV.isSelected())
-					_yMarginV.modifyString(event.text.unicode);
+				selected->modifyString(event.text.unicode);
 			}
 			return ActionEvent::NONE;
 		}
@@ -2195,20 +6831,20 @@ namespace ui
 		void draw(sf::RenderWindow& window, const sf::Vector2f& point)
 		{
 			_back.draw(window);
-			_packerSettings.draw(window);
-			_dimensions.draw(window);
-			_maxWidth.draw(window);
-			_maxHeight.draw(window);
-			_margins.draw(window);
-			_xMargin.draw(window);
-			_yMargin.draw(window);
 
-			bool cursor = (_clock.getElapsedTime().asMilliseconds() / Defined::CursorBlinkInterval) & 1;
-			_maxWidthV.draw(window, point, cursor);
-			_maxHeightV.draw(window, point, cursor);
-			_xMarginV.draw(window, point, cursor);
-			_yMarginV.draw(window, point, cursor);
+			_blocks.setText(std::string("Output format: ") + px::formatName(static_cast<px::TextureFormat>(_formatV.getValue())));
+			const std::vector<TextBox*> labels = _labels();
+			for (size_t i = 0; i < labels.size(); ++i)
+				labels[i]->draw(window);
 
+			const std::vector<TickBox*> tickBoxes = _tickBoxes();
+			for (size_t i = 0; i < tickBoxes.size(); ++i)
+				tickBoxes[i]->draw(window, point);
+
+			bool cursor = (_clock.getElapsedTime().asMilliseconds() / Defined::CursorBlinkInterval) & 1;
+			const std::vector<IntegerInputBox*> inputs = _inputs();
+			for (size_t i = 0; i < inputs.size(); ++i)
+				inputs[i]->draw(window, point, cursor);
 		}
 	};
 	
@@ -2255,6 +6891,8 @@ namespace ui
 		}
 		void saveToFile(const std::string& path, const bool allowOverwrite)
 		{
+			_images.finishLoading();
+
 			std::string temp;
 			if (allowOverwrite)
 				temp = path + "\\" + _name;
@@ -2274,9 +6912,68 @@ namespace ui
 
 			_images.saveToFile(temp + "\\" + _name + "_img");
 		}
-		bool exportToImage(const std::string& path, const bool createMapFile) const
+		// channel sets are exported with this atlas' layout, matched by image name, next to it as atlas_<set name>,
+		// scale variants as atlas@<n>x with the layout divided down from the highest scale,
+		// the layout is packed once and every set and variant is composed at the same time
+		bool exportToImage(const std::string& path, ExportSettings settings, const std::vector<Atlas*>& channelSets = std::vector<Atlas*>())
+		{
+			_images.finishLoading();
+			settings.channelSets.clear();
+			std::vector<const ImageVector*> layouts(1, &_images);
+			std::vector<std::unique_ptr<ImageVector>> owned;
+			std::vector<std::string> setSuffixes(1, "");
+			for (size_t s = 0; s < channelSets.size(); ++s)
+			{
+				channelSets[s]->_images.finishLoading();
+				owned.push_back(channelSets[s]->_images.withLayout(_images));
+				layouts.push_back(owned.back().get());
+				setSuffixes.push_back('_' + channelSets[s]->getName());
+				settings.channelSets.push_back(channelSets[s]->getName());
+			}
+
+			struct Job
+			{
+				const ImageVector* images;
+				std::string path;
+				ExportSettings settings;
+			};
+			std::vector<Job> jobs;
+			for (unsigned int divisor = 1; divisor <= std::max(1u, settings.variantScale); divisor *= 2)
+				for (size_t s = 0; s < layouts.size(); ++s)
+				{
+					const ImageVector* images = layouts[s];
+					if (divisor > 1)
+					{
+						owned.push_back(layouts[s]->scaledCopy(divisor));
+						images = owned.back().get();
+					}
+					const std::string variant = settings.variantScale > 1 ? '@' + std::to_string(settings.variantScale / divisor) + 'x' : "";
+					Job job{ images, ImageVector::getSuffixedPath(path, setSuffixes[s] + variant), settings };
+					job.settings.createMapFile = settings.createMapFile && s == 0 && divisor == 1;
+					// exact, the settings menu rounds extrude up to a multiple of the variant scale
+					job.settings.extrude = settings.extrude / divisor;
+					jobs.push_back(job);
+				}
+
+			std::atomic<bool> exported(true);
+			util::parallelFor(jobs.size(), [&](const size_t j)
+			{
+				if (!jobs[j].images->exportToImage(jobs[j].path, jobs[j].settings))
+					exported = false;
+			}, jobs.size());
+			return exported;
+		}
+
+		// another atlas shares at least one image name with this one
+		bool sharesImages(Atlas& other)
 		{
-			return _images.exportToImage(path, createMapFile);
+			std::set<std::string> names;
+			for (size_t i = 0; i < _images.size(); ++i)
+				names.insert(_images[i].getNameTag());
+			for (size_t i = 0; i < other._images.size(); ++i)
+				if (names.count(other._images[i].getNameTag()))
+					return true;
+			return false;
 		}
 
 		static Atlas loadFromFile(const std::string& filepath)
@@ -2326,6 +7023,7 @@ namespace ui
 		SettingsMenu _settingsMenu;
 
 		pk::Packer _packer;
+		img::ExportSettings _exportSettings;
 
 		os::OpenFileDialog _openFileDialog;
 		os::SaveFileDialog _saveFileDialog;
@@ -2399,6 +7097,10 @@ namespace ui
 					{
 						_tabs[_frontTab].accessData().deleteImages(true);
 					}
+					else if (optionsResult == ActionEvent::GROUP_IMAGES)
+						_tabs[_frontTab].accessData().groupSelected();
+					else if (optionsResult == ActionEvent::UNGROUP_IMAGES)
+						_tabs[_frontTab].accessData().ungroupSelected();
 				}
 				else if (_fileMenu.isOpen())
 				{
@@ -2511,14 +7213,16 @@ namespace ui
 						{
 							_settingsB.setSelected(false);
 							_packer.changeSettings(_settingsMenu.close());
+							_exportSettings = _settingsMenu.getExportSettings();
 						}
 
 						if (_packB.contains(mousePos))
 						{
-							_packer.loadRects(_tabs[_frontTab].accessData());
-							if (_packer.packImages())
+							_tabs[_frontTab].accessData().finishLoading();
+							if (_packer.packWithinBudget(_tabs[_frontTab].accessData()))
 							{
 								_packer.applyChanges();
+								_tabs[_frontTab].accessData().setPages(_packer.getPages());
 								_tabs[_frontTab].accessData().applyBasePosition();
 							}
 						}
@@ -2775,7 +7479,14 @@ namespace ui
 				if (_saveFileDialog.isStarted() && _saveFileDialog.isReady())
 				{
 					if (_saveFileDialog.getPath().size())
-						_tabs[_frontTab].exportToImage(util::toString(_saveFileDialog.getPath()), true);
+					{
+						std::vector<Atlas*> channelSets;
+						if (_exportSettings.sharedLayout)
+							for (size_t i = 0; i < _tabs.size(); ++i)
+								if (i != _frontTab && _tabs[_frontTab].sharesImages(_tabs[i]))
+									channelSets.push_back(&_tabs[i]);
+						_tabs[_frontTab].exportToImage(_settingsMenu.getExportPath(util::toString(_saveFileDialog.getPath())), _exportSettings, channelSets);
+					}
 				}
 				if (_selectFolderDialog.isStarted() && _selectFolderDialog.isReady())
 				{
@@ -2786,6 +7497,11 @@ namespace ui
 					}
 				}
 
+				// textures of imported images are uploaded a few at a time so the editor keeps drawing
+				const sf::Clock frame;
+				for (size_t i = 0; i < _tabs.size(); ++i)
+					_tabs[i].accessData().applyDecoded(frame, sf::milliseconds(8));
+
 				_displayEditor();
 			}
 			return ActionEvent::NONE;
@@ -3053,6 +7769,7 @@ namespace ui
 	};
 }
 
+#ifndef TEXTUREPACKER_NO_MAIN
 int main()
 {
 	if (ui::Defined::load())
@@ -3070,3 +7787,4 @@ int main()
 	ui::Defined::release();
 	return 0;
 }
+#endif
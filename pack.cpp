@@ -1,6 +1,8 @@
 #include "pack.h"
 #include <cstring>
 #include <algorithm>
+#include <map>
+#include <set>
 
 using namespace std;
 
@@ -228,31 +230,186 @@ rect_wh _rect2D(rect_xywhf* const * v, int n, int max_w, int max_h, bool allowFl
 }
 
 
+// fills one bin of at most max_w x max_h, whatever doesn't fit (or belongs to a group split by the bin) is left for the next one
+static void _fill(vector<rect_xywhf*>& in, int max_w, int max_h, bool allowFlip, map<int, long long>& group_area, bin& b, vector<rect_xywhf*>& left) {
+	vector<rect_xywhf*> held;
+	left.clear();
+
+	while(true) {
+		b.size = _rect2D(&in[0], static_cast<int>(in.size()), max_w, max_h, allowFlip, b.rects, left);
+
+		// groups with rects on both sides of this bin are held back for the next one, the bin is packed again without them
+		set<int> inside, split;
+		for(size_t i = 0; i < b.rects.size(); ++i)
+			if(b.rects[i]->group) inside.insert(b.rects[i]->group);
+		for(size_t i = 0; i < left.size(); ++i) {
+			int g = left[i]->group;
+			if(g && inside.count(g) && group_area[g] <= (long long)max_w * max_h) split.insert(g);
+		}
+
+		size_t kept = 0;
+		for(size_t i = 0; i < b.rects.size(); ++i)
+			if(!split.count(b.rects[i]->group)) ++kept;
+
+		if(split.empty() || !kept) break;
+
+		for(size_t i = 0; i < b.rects.size(); ++i)
+			if(b.rects[i]->flipped) b.rects[i]->flip();
+
+		vector<rect_xywhf*> rest;
+		for(size_t i = 0; i < in.size(); ++i) {
+			if(split.count(in[i]->group)) held.push_back(in[i]);
+			else rest.push_back(in[i]);
+		}
+		in.swap(rest);
+		b.rects.clear();
+		left.clear();
+	}
+	left.insert(left.end(), held.begin(), held.end());
+}
+
 bool pack(rect_xywhf* const * v, int n, int max_w, int max_h, bool allowFlip, vector<bin>& bins) {
 	rect_wh _rect(max_w, max_h);
 
 	for(int i = 0; i < n; ++i) 
 		if(!v[i]->fits(_rect,allowFlip)) return false;
 
-	vector<rect_xywhf*> vec[2], *p[2] = { vec, vec+1 };
-	vec[0].resize(n);
-	vec[1].clear();
-	std::memcpy(&vec[0][0], v, sizeof(rect_xywhf*)*n);
+	vector<rect_xywhf*> in(v, v+n), left;
 
-	bin* b = 0;
+	// total area of every group, groups bigger than a bin can't be kept together anyway
+	map<int, long long> group_area;
+	for(int i = 0; i < n; ++i)
+		if(v[i]->group) group_area[v[i]->group] += v[i]->area();
 
 	while(true) {
 		bins.push_back(bin());
-		b = &bins[bins.size()-1];
+		_fill(in, max_w, max_h, allowFlip, group_area, bins.back(), left);
+
+		if(left.empty()) break;
+
+		in.swap(left);
+	}
+
+	return true;
+}
+
+static void _unflip(bin& b) {
+	for(size_t i = 0; i < b.rects.size(); ++i)
+		if(b.rects[i]->flipped) b.rects[i]->flip();
+}
 
-		b->size = _rect2D(&((*p[0])[0]), static_cast<int>(p[0]->size()), max_w, max_h, allowFlip, b->rects, *p[1]);
-		p[0]->clear();
+// the smallest of sizes[first] and the ones after it (sorted largest first) that takes every rect in one bin, -1 if none does
+static int _single(const vector<rect_xywhf*>& in, const vector<rect_wh>& sizes, size_t first, bool allowFlip, map<int, long long>& group_area, bin& b) {
+	long long total = 0;
+	for(size_t i = 0; i < in.size(); ++i)
+		total += (long long)in[i]->w * in[i]->h;
+
+	for(size_t s = sizes.size(); s-- > first;) {
+		bool fits = total <= (long long)sizes[s].w * sizes[s].h;
+		for(size_t i = 0; i < in.size() && fits; ++i)
+			fits = in[i]->fits(sizes[s],allowFlip) != 0;
+		if(!fits) continue;
+
+		vector<rect_xywhf*> trial(in), left;
+		b = bin();
+		_fill(trial, sizes[s].w, sizes[s].h, allowFlip, group_area, b, left);
+		if(left.empty()) {
+			b.size = sizes[s];
+			return static_cast<int>(s);
+		}
+		_unflip(b);
+	}
+	return -1;
+}
 
-		if(!p[1]->size()) break;
+// bins of sizes[s] until the rest fits in a single bin no larger, that one gets the smallest size holding it,
+// returns the total area plus that of the smallest size for every bin, or -1 if the rects can't be placed this way,
+// they're only left in place, and the bins added to keep, when the plan works out
+static long long _plan(vector<rect_xywhf*> in, const vector<rect_wh>& sizes, size_t s, bool allowFlip, map<int, long long>& group_area, vector<bin>* keep) {
+	const long long per_bin = (long long)sizes.back().w * sizes.back().h;
+	long long total = 0;
+	vector<rect_xywhf*> left;
+	vector<bin> planned;
+
+	while(true) {
+		planned.push_back(bin());
+		bin& b = planned.back();
+		const int single = _single(in, sizes, s, allowFlip, group_area, b);
+		if(single < 0) {
+			_fill(in, sizes[s].w, sizes[s].h, allowFlip, group_area, b, left);
+			b.size = sizes[s];
+		}
+		else left.clear();
+
+		total += (long long)b.size.w * b.size.h + per_bin;
+		if(b.rects.empty()) break;
+		if(left.empty()) {
+			if(keep) keep->insert(keep->end(), planned.begin(), planned.end());
+			else for(size_t i = 0; i < planned.size(); ++i) _unflip(planned[i]);
+			return total;
+		}
 
-		std::swap(p[0], p[1]);
+		in.swap(left);
 	}
 
+	for(size_t i = 0; i < planned.size(); ++i) _unflip(planned[i]);
+	return -1;
+}
+
+bool pack(rect_xywhf* const * v, int n, vector<rect_wh> sizes, bool allowFlip, vector<bin>& bins) {
+	if(sizes.empty()) return false;
+
+	sort(sizes.begin(), sizes.end(), [](rect_wh& a, rect_wh& b) { return a.area() > b.area(); });
+	rect_wh largest = sizes[0];
+
+	for(int i = 0; i < n; ++i) 
+		if(!v[i]->fits(largest,allowFlip)) return false;
+
+	vector<rect_xywhf*> in(v, v+n), left;
+
+	map<int, long long> group_area;
+	for(int i = 0; i < n; ++i)
+		if(v[i]->group) group_area[v[i]->group] += v[i]->area();
+
+	// bins are filled at the largest size while what's left takes more than one of them,
+	// they go to bins with the rest once that's placed too
+	vector<bin> planned;
+	while(!in.empty()) {
+		long long total = 0;
+		for(size_t i = 0; i < in.size(); ++i)
+			total += in[i]->area();
+		if(total <= largest.area()) break;
+
+		planned.push_back(bin());
+		_fill(in, largest.w, largest.h, allowFlip, group_area, planned.back(), left);
+		planned.back().size = largest;
+		in.swap(left);
+	}
+	if(in.empty()) {
+		bins.insert(bins.end(), planned.begin(), planned.end());
+		return true;
+	}
+
+	// the rest goes to the size whose plan has the least area, a few smaller bins often beat one large mostly empty one,
+	// but every bin is also charged the smallest size so a handful of bytes isn't saved with many more texture binds
+	long long best = -1;
+	size_t best_size = 0;
+	for(size_t s = 0; s < sizes.size(); ++s) {
+		bool fits = true;
+		for(size_t i = 0; i < in.size() && fits; ++i)
+			fits = in[i]->fits(sizes[s],allowFlip) != 0;
+		if(!fits) break;
+
+		const long long area = _plan(in, sizes, s, allowFlip, group_area, 0);
+		if(area >= 0 && (best < 0 || area < best)) {
+			best = area;
+			best_size = s;
+		}
+	}
+
+	if(_plan(in, sizes, best_size, allowFlip, group_area, &planned) < 0) return false;
+
+	bins.insert(bins.end(), planned.begin(), planned.end());
 	return true;
 }
 
@@ -331,11 +488,11 @@ int rect_wh::perimeter() {
 }
 
 
-rect_xywhf::rect_xywhf(const rect_ltrb& rr) : rect_xywh(rr), flipped(false) {}
-rect_xywhf::rect_xywhf(int x, int y, int width, int height) : rect_xywh(x, y, width, height), flipped(false) {}
-rect_xywhf::rect_xywhf() : flipped(false) {}
+rect_xywhf::rect_xywhf(const rect_ltrb& rr) : rect_xywh(rr), flipped(false), group(0) {}
+rect_xywhf::rect_xywhf(int x, int y, int width, int height) : rect_xywh(x, y, width, height), flipped(false), group(0) {}
+rect_xywhf::rect_xywhf() : flipped(false), group(0) {}
 
 void rect_xywhf::flip() { 
 	flipped = !flipped;
 	std::swap(w, h);
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -21,6 +21,15 @@
 
 	returns true on success, false if one of the rectangles' dimension was bigger than max_side
 
+	Rectangles with the same non zero "group" are moved to a later bin together instead of being split across bins,
+	as long as the group's area fits in a single bin.
+
+4. bool pack(rect_xywhf* const * v, int n, std::vector<rect_wh> sizes, bool allowFlip, std::vector<bin>& bins) - packing into a set of allowed bin sizes
+	Every bin is exactly one of the given sizes. Bins are filled at the largest size until the rectangles left fit in a single bin,
+	which gets the smallest size that holds them all, so the total area (and so the texture memory) of the bins stays low.
+
+	returns false if one of the rectangles doesn't fit in the largest size or no size is given
+
 You want to your rectangles representing your textures/glyph objects with GL_MAX_TEXTURE_SIZE as max_side,
 then for each bin iterate through its rectangles, typecast each one to your own structure (or manually add userdata) and then memcpy its pixel contents (rotated by 90 degrees if "flipped" rect_xywhf's member is true)
 to the array representing your texture atlas to the place specified by the rectangle, then finally upload it with glTexImage2D.
@@ -71,6 +80,7 @@ struct rect_xywhf : public rect_xywh {
 	rect_xywhf();
 	void flip();
 	bool flipped;
+	int group; // rects sharing a non zero group are kept in the same bin whenever the group fits in one
 };
 
 
@@ -80,3 +90,4 @@ struct bin {
 };
 
 bool pack(rect_xywhf* const * v, int n, int max_w, int max_h, bool allowFlip, std::vector<bin>& bins);
+bool pack(rect_xywhf* const * v, int n, std::vector<rect_wh> sizes, bool allowFlip, std::vector<bin>& bins);
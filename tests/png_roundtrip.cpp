@@ -0,0 +1,153 @@
+// round trip of the streaming PNG writer: pages written band by band with its own deflate, zlib stream and CRCs,
+// then read back with zlib as an independent inflater and compared pixel for pixel
+// build next to the packer, e.g. cl /std:c++17 /EHsc tests\png_roundtrip.cpp pack.cpp sfml-graphics.lib sfml-system.lib zlib.lib
+#define TEXTUREPACKER_NO_MAIN
+#include "../TexturePacker.cpp"
+#include <zlib.h>
+#include <cstdio>
+
+namespace
+{
+	sf::Uint32 readBE(const unsigned char* data)
+	{
+		return static_cast<sf::Uint32>(data[0]) << 24 | static_cast<sf::Uint32>(data[1]) << 16 | static_cast<sf::Uint32>(data[2]) << 8 | data[3];
+	}
+
+	// decodes an 8 bit RGBA, non interlaced PNG, every chunk's CRC is checked on the way
+	bool decodePng(const std::string& path, sf::Vector2u& size, std::vector<unsigned char>& pixels, std::string& error)
+	{
+		std::ifstream in(path, std::ios::binary);
+		const std::vector<unsigned char> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		if (file.size() < 8 || !std::equal(signature, signature + 8, file.begin()))
+			return error = "bad signature", false;
+
+		std::vector<unsigned char> idat;
+		bool end = false;
+		for (size_t at = 8; !end; )
+		{
+			if (at + 12 > file.size())
+				return error = "truncated chunk", false;
+			const sf::Uint32 length = readBE(&file[at]);
+			if (at + 12 + length > file.size())
+				return error = "truncated chunk", false;
+			const std::string type(file.begin() + at + 4, file.begin() + at + 8);
+			const unsigned char* data = &file[at + 8];
+			if (::crc32(::crc32(0L, Z_NULL, 0), &file[at + 4], length + 4) != readBE(data + length))
+				return error = "bad CRC in " + type, false;
+
+			if (type == "IHDR")
+			{
+				size = sf::Vector2u(readBE(data), readBE(data + 4));
+				if (data[8] != 8 || data[9] != 6 || data[12] != 0)
+					return error = "not 8 bit RGBA", false;
+			}
+			else if (type == "IDAT")
+				idat.insert(idat.end(), data, data + length);
+			else if (type == "IEND")
+				end = true;
+			at += 12 + length;
+		}
+
+		const size_t stride = static_cast<size_t>(size.x) * 4;
+		std::vector<unsigned char> filtered((stride + 1) * size.y);
+		uLongf length = static_cast<uLongf>(filtered.size());
+		if (::uncompress(filtered.data(), &length, idat.data(), static_cast<uLong>(idat.size())) != Z_OK || length != filtered.size())
+			return error = "zlib stream doesn't inflate to the image", false;
+
+		pixels.assign(stride * size.y, 0);
+		for (unsigned int y = 0; y < size.y; ++y)
+		{
+			const unsigned char filter = filtered[y * (stride + 1)];
+			const unsigned char* src = &filtered[y * (stride + 1) + 1];
+			unsigned char* row = &pixels[y * stride];
+			const unsigned char* up = y ? &pixels[(y - 1) * stride] : nullptr;
+			for (size_t i = 0; i < stride; ++i)
+			{
+				const int a = i >= 4 ? row[i - 4] : 0, b = up ? up[i] : 0, c = up && i >= 4 ? up[i - 4] : 0;
+				int predicted = 0;
+				switch (filter)
+				{
+				case 0: break;
+				case 1: predicted = a; break;
+				case 2: predicted = b; break;
+				case 3: predicted = (a + b) / 2; break;
+				case 4:
+				{
+					const int p = a + b - c, pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+					predicted = pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+					break;
+				}
+				default: return error = "bad filter type", false;
+				}
+				row[i] = static_cast<unsigned char>(src[i] + predicted);
+			}
+		}
+		return true;
+	}
+
+	// smooth gradients, flat areas, transparent holes and noise, so every filter and match length gets used
+	std::vector<sf::Uint8> makePixels(const sf::Vector2u& size, const unsigned int seed)
+	{
+		std::vector<sf::Uint8> pixels(static_cast<size_t>(size.x) * size.y * 4);
+		sf::Uint32 state = seed * 2654435761u + 1;
+		for (unsigned int y = 0; y < size.y; ++y)
+			for (unsigned int x = 0; x < size.x; ++x)
+			{
+				sf::Uint8* p = &pixels[(static_cast<size_t>(y) * size.x + x) * 4];
+				state = state * 1664525u + 1013904223u;
+				const unsigned int region = (x / 37 + y / 23) % 4;
+				p[0] = region == 3 ? static_cast<sf::Uint8>(state >> 24) : static_cast<sf::Uint8>(x * 3 + y);
+				p[1] = region == 2 ? 0x40 : static_cast<sf::Uint8>(y * 5);
+				p[2] = static_cast<sf::Uint8>((x ^ y) + (region == 3 ? state >> 16 : 0));
+				p[3] = region == 1 ? 0 : region == 2 ? 0x80 : 0xFF;
+			}
+		return pixels;
+	}
+}
+
+int main()
+{
+	const sf::Vector2u sizes[] = { sf::Vector2u(1, 1), sf::Vector2u(7, 3), sf::Vector2u(300, 257), sf::Vector2u(1025, 600) };
+	const int levels[] = { 0, 1, 6, 9 };
+	const size_t threads[] = { 1, 4 };
+	const unsigned int bands[] = { 1, 16, 256 };
+
+	int failures = 0, runs = 0;
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+		for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); ++l)
+			for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); ++t)
+				for (size_t b = 0; b < sizeof(bands) / sizeof(bands[0]); ++b)
+				{
+					const sf::Vector2u size = sizes[s];
+					const std::vector<sf::Uint8> source = makePixels(size, static_cast<unsigned int>(s * 131 + l * 17 + t * 7 + b));
+					const std::string path = "png_roundtrip_test.png";
+
+					bool written;
+					{
+						px::PngWriter writer(path, size, levels[l], threads[t]);
+						written = true;
+						for (unsigned int top = 0; top < size.y && written; top += bands[b])
+							written = writer.writeRows(source.data() + static_cast<size_t>(top) * size.x * 4, std::min(bands[b], size.y - top));
+						written = written && writer.finish();
+					}
+
+					sf::Vector2u decodedSize;
+					std::vector<unsigned char> decoded;
+					std::string error = "writer failed";
+					const bool ok = written && decodePng(path, decodedSize, decoded, error)
+						&& (decodedSize == size || (error = "wrong size", false))
+						&& (std::equal(source.begin(), source.end(), decoded.begin()) || (error = "pixels differ", false));
+					std::remove(path.c_str());
+
+					++runs;
+					if (!ok)
+					{
+						++failures;
+						std::cout << "FAIL " << size.x << 'x' << size.y << " level " << levels[l] << " threads " << threads[t] << " band " << bands[b] << ": " << error << '\n';
+					}
+				}
+
+	std::cout << runs - failures << '/' << runs << " round trips passed\n";
+	return failures ? 1 : 0;
+}